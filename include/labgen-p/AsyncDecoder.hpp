@@ -0,0 +1,95 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "FrameSource.hpp"
+
+/* ========================================================================== *
+ * AsyncDecoder                                                               *
+ * ========================================================================== */
+
+/*
+ * Reads a sequence in a dedicated thread into a bounded ring of frames
+ * allocated once. The consumer borrows one frame at a time with acquire() and
+ * gives it back with release(), so that the buffer can be decoded into again.
+ * With a stride k, only every k-th frame is decoded, the others being merely
+ * grabbed.
+ */
+class AsyncDecoder {
+  private:
+
+    FrameSource& source;
+    std::vector<cv::Mat> buffers;
+    size_t stride;
+
+    size_t head;
+    size_t tail;
+    size_t count;
+    bool finished;
+    bool stopped;
+
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::thread thread;
+    std::exception_ptr error;
+
+    /* Time spent decoding, and waiting for decoded frames, in seconds. */
+    double decodeTime;
+    double waitTime;
+
+  public:
+
+    AsyncDecoder(
+      FrameSource& source,
+      size_t capacity = 4,
+      size_t stride = 1
+    );
+
+    ~AsyncDecoder();
+
+    void start();
+
+    void stop();
+
+    /* Returns NULL once the sequence is exhausted. */
+    const cv::Mat* acquire();
+
+    void release();
+
+    /* Time spent by the thread decoding the frames, valid once stopped. */
+    double getDecodeTime() const { return decodeTime; }
+
+    /* Time spent by the consumer waiting in acquire(). */
+    double getWaitTime() const { return waitTime; }
+
+  protected:
+
+    void run();
+};
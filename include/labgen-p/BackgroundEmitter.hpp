@@ -0,0 +1,86 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <opencv2/core/core.hpp>
+
+/* ========================================================================== *
+ * BackgroundEmitter                                                          *
+ * ========================================================================== */
+
+/*
+ * Hands snapshots of the background over to a callback run in a dedicated
+ * thread, for instance to write them to files while the sequence is still
+ * being processed. emit() only copies the snapshot into a double buffer: if
+ * the callback is still busy with a previous snapshot, the one waiting for it
+ * is replaced by the newer one and counted as dropped, so that the emission
+ * never stalls the processing.
+ */
+class BackgroundEmitter {
+  public:
+
+    typedef std::function<void(const cv::Mat&, size_t)>               Callback;
+
+  private:
+
+    Callback callback;
+
+    cv::Mat pending;
+    cv::Mat current;
+    size_t pendingFrame;
+    bool hasPending;
+    size_t dropped;
+    bool stopped;
+
+    mutable std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::thread thread;
+    std::exception_ptr error;
+
+  public:
+
+    explicit BackgroundEmitter(Callback callback);
+
+    ~BackgroundEmitter();
+
+    void start();
+
+    /*
+     * Waits for the pending snapshot to be handed over, then rethrows the
+     * first exception thrown by the callback, if any.
+     */
+    void stop();
+
+    /* Copies the background of the given frame for the callback. */
+    void emit(const cv::Mat& background, size_t frame);
+
+    size_t getDropped() const;
+
+  protected:
+
+    void run();
+};
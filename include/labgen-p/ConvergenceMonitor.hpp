@@ -0,0 +1,73 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+
+/* ========================================================================== *
+ * ConvergenceMonitor                                                         *
+ * ========================================================================== */
+
+/*
+ * Follows the rate of history replacements per frame, i.e. the number of
+ * modified histories divided by their total number. The estimation is
+ * considered converged once this rate stays below a threshold for a given
+ * number of consecutive frames. A threshold of 0 disables the monitor.
+ */
+class ConvergenceMonitor {
+  private:
+
+    double threshold;
+    size_t patience;
+    size_t stableFrames;
+
+  public:
+
+    ConvergenceMonitor(double threshold, size_t patience) :
+    threshold(threshold), patience(patience), stableFrames(0) {
+      if (threshold < 0 || threshold > 1)
+        throw std::logic_error("The convergence threshold must be in [0, 1]");
+
+      if (patience == 0)
+        throw std::logic_error("The patience must be positive");
+    }
+
+    bool isEnabled() const { return threshold > 0; }
+
+    size_t getStableFrames() const { return stableFrames; }
+
+    /*
+     * Accounts for a frame that modified modified histories out of total, and
+     * returns true once converged.
+     */
+    bool update(size_t modified, size_t total) {
+      if (!isEnabled() || total == 0)
+        return false;
+
+      if (static_cast<double>(modified) < threshold * total)
+        ++stableFrames;
+      else
+        stableFrames = 0;
+
+      return stableFrames >= patience;
+    }
+
+    void reset() { stableFrames = 0; }
+};
@@ -0,0 +1,76 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "ThreadPool.hpp"
+
+/* ========================================================================== *
+ * Decimation                                                                 *
+ * ========================================================================== */
+
+/*
+ * Conversions between an image and its version reduced by an integer factor,
+ * each pixel of which covers a block of factor x factor pixels, the blocks of
+ * the last row and column being cropped to the image. The reduced size is
+ * thus the size divided by the factor, rounded up.
+ */
+class Decimation {
+  protected:
+
+    /*
+     * Sums of the rows of a band of blocks, one row of blocks at a time, for
+     * each band of decimated rows processed in parallel.
+     */
+    std::vector<uint32_t> rowSums;
+
+  public:
+
+    Decimation() : rowSums() {}
+
+    static int getReducedSize(int size, int factor) {
+      return (size + factor - 1) / factor;
+    }
+
+    /*
+     * Writes into the allocated matrix decimated the rounded means of the
+     * blocks of the CV_8UC1 or CV_8UC3 frame, having the same type.
+     */
+    void decimate(
+      const cv::Mat& frame,
+      cv::Mat& decimated,
+      int factor,
+      ThreadPool* pool = NULL
+    );
+
+    /*
+     * Writes into the allocated output, having the type of the CV_16UC1 or
+     * CV_32SC1 matrix decimated, the value of the block of each pixel.
+     */
+    static void replicate(
+      const cv::Mat& decimated,
+      cv::Mat& output,
+      int factor,
+      ThreadPool* pool = NULL
+    );
+};
@@ -0,0 +1,86 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+/* ========================================================================== *
+ * DeviceMotion                                                               *
+ * ========================================================================== */
+
+/*
+ * Quantities of motion computed on an OpenCL device through the transparent
+ * API of OpenCV 3: the luma of each frame, its absolute difference with the
+ * luma of the previous frame, and the box sums of the motion scores for each
+ * kernel size, the pixels outside of the image counting as zeros. Only the
+ * frame is uploaded and the quantities of motion downloaded, the lumas
+ * staying on the device. The results are the same as the ones of
+ * FrameDifferenceC1L1 and MotionProba, the luma being computed with
+ * cv::cvtColor(CV_BGR2GRAY).
+ *
+ * With OpenCV 2, or without any OpenCL device, isAvailable() returns false
+ * and the constructor throws.
+ */
+class DeviceMotion {
+  private:
+
+    std::vector<int32_t> kernelSizes;
+    int current;
+    bool primed;
+
+#if CV_MAJOR_VERSION >= 3
+    cv::UMat frame;
+    cv::UMat luma[2];
+    cv::UMat scores;
+    std::vector<cv::UMat> deviceQuantities;
+#endif /* CV_MAJOR_VERSION >= 3 */
+
+  public:
+
+    /* Whether an OpenCL device can be used. */
+    static bool isAvailable();
+
+    explicit DeviceMotion(const std::vector<int32_t>& kernelSizes);
+
+    /*
+     * Writes the quantities of motion of the CV_8UC3 frame, or of its CV_8UC1
+     * luma, into the allocated quantities, one CV_16UC1 or CV_32SC1 matrix per
+     * kernel size. Nothing is computed for the first frame, which only
+     * provides the previous luma.
+     */
+    void process(const cv::Mat& img_input, std::vector<cv::Mat>& quantities);
+
+    /* The next frame is processed as a first frame. */
+    void reset() { primed = false; }
+
+    /* Whether a frame has been processed since the last reset. */
+    bool isPrimed() const { return primed; }
+
+    /* Downloads the luma of the last frame processed. */
+    void getLuma(cv::Mat& luma) const;
+
+    /*
+     * Restores the luma of the last frame processed, the next frame being
+     * compared with it.
+     */
+    void prime(const cv::Mat& previous);
+};
@@ -18,23 +18,109 @@
  */
 #pragma once
 
+#include <cstdint>
+
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include "SummedAreaTables.hpp"
+#include "ThreadPool.hpp"
+
 /* ========================================================================== *
  * FrameDifferenceC1L1                                                        *
  * ========================================================================== */
 
+/*
+ * Motion scores as the absolute difference between the luma of two
+ * consecutive frames. Each pixel of the input frame is read once: its luma is
+ * computed with the coefficients of cv::cvtColor(CV_BGR2GRAY), stored, and
+ * immediately compared with the luma of the previous frame. The two luma
+ * buffers are swapped from frame to frame instead of being copied. Nothing is
+ * computed for the first frame, which only provides the previous luma.
+ *
+ * Given a thread pool, bands of rows are processed concurrently. The summed
+ * area table is then built in two passes: the running sums of the rows along
+ * with the luma, then their accumulation down bands of columns.
+ */
 class FrameDifferenceC1L1 {
   private:
 
-    cv::Mat img_input_prev;
+    cv::Mat luma[2];
+    int current;
+    bool primed;
+    ThreadPool* pool;
 
   public:
 
-    FrameDifferenceC1L1() {}
+    FrameDifferenceC1L1(ThreadPool* pool = NULL) :
+      current(0), primed(false), pool(pool) {}
 
     ~FrameDifferenceC1L1() {}
 
+    /*
+     * Writes the motion scores into proba_map, a CV_8UC1 matrix holding all
+     * of them, or a CV_32SC1 one.
+     */
     void process(const cv::Mat& img_input, cv::Mat& proba_map);
+
+    /*
+     * Accumulates the motion scores directly into the summed area table sums,
+     * in the same pass, without storing them.
+     */
+    void process(const cv::Mat& img_input, SummedAreaTables<int32_t>& sums);
+
+    /*
+     * Only computes the luma of the frame, the motion scores being left to the
+     * caller, see getPreviousLuma(). Returns false for a first frame.
+     */
+    bool update(const cv::Mat& img_input);
+
+    /* The next frame is processed as a first frame, the buffers being kept. */
+    void reset() { primed = false; }
+
+    /* Whether a frame has been processed since the last reset. */
+    bool isPrimed() const { return primed; }
+
+    /* Luma of the last frame processed. */
+    const cv::Mat& getLuma() const { return luma[current]; }
+
+    /* Luma of the frame preceding the last frame processed. */
+    const cv::Mat& getPreviousLuma() const { return luma[1 - current]; }
+
+    /*
+     * Restores the luma of the last frame processed, the next frame being
+     * compared with it.
+     */
+    void prime(const cv::Mat& previous);
+
+    /* Allocates the buffers for frames of the given size beforehand. */
+    void allocate(int rows, int cols);
+
+  protected:
+
+    /* Swaps the luma buffers, returns false for the first frame. */
+    bool swap(const cv::Mat& img_input);
+
+    template <bool Integral, typename Score>
+    void processRow(
+      const cv::Mat& img_input,
+      int row,
+      Score* proba,
+      const int32_t* above
+    );
+
+    template <int Channels, bool Integral, typename Score>
+    void processChannels(
+      const cv::Mat& img_input,
+      int row,
+      Score* proba,
+      const int32_t* above
+    );
+
+    template <bool Integral, typename Score>
+    void processRows(
+      const cv::Mat& img_input,
+      cv::Mat* proba_map,
+      SummedAreaTables<int32_t>* sums
+    );
 };
@@ -0,0 +1,133 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+/* ========================================================================== *
+ * FrameSource                                                                *
+ * ========================================================================== */
+
+/* Sequence of frames of the same size read one after the other. */
+class FrameSource {
+  public:
+
+    virtual ~FrameSource() {}
+
+    /* Reads the next frame into a matrix allocated by allocate(). */
+    virtual bool read(cv::Mat& frame) = 0;
+
+    /* Skips the next frame, without decoding it if possible. */
+    virtual bool grab() = 0;
+
+    /* Allocates a matrix holding a frame. */
+    virtual cv::Mat allocate() const = 0;
+
+    /* Size of the images of the frames. */
+    virtual int getHeight() const = 0;
+
+    virtual int getWidth() const = 0;
+
+    /* Number of frames of the sequence, 0 if unknown, as for a camera. */
+    virtual size_t getFrameCount() const = 0;
+
+    /* Closes the sequence, no frame being read anymore. */
+    virtual void release() = 0;
+};
+
+/* ========================================================================== *
+ * VideoSource                                                                *
+ * ========================================================================== */
+
+/* CV_8UC3 frames decoded by OpenCV. */
+class VideoSource : public FrameSource {
+  private:
+
+    cv::VideoCapture& decoder;
+    int height;
+    int width;
+
+  public:
+
+    explicit VideoSource(cv::VideoCapture& decoder);
+
+    virtual bool read(cv::Mat& frame) { return decoder.read(frame); }
+
+    virtual bool grab() { return decoder.grab(); }
+
+    virtual cv::Mat allocate() const { return cv::Mat(height, width, CV_8UC3); }
+
+    virtual int getHeight() const { return height; }
+
+    virtual int getWidth() const { return width; }
+
+    virtual size_t getFrameCount() const;
+
+    virtual void release() { decoder.release(); }
+};
+
+/* ========================================================================== *
+ * I420Source                                                                 *
+ * ========================================================================== */
+
+/*
+ * Raw I420 frames read from a file, or from the standard input given "-",
+ * such as the ones written by "ffmpeg -f rawvideo -pix_fmt yuv420p". The
+ * frames are read as is, see I420.
+ */
+class I420Source : public FrameSource {
+  private:
+
+    FILE* file;
+    int height;
+    int width;
+    size_t frameSize;
+
+    /* Skipped frames of a stream that cannot be sought. */
+    std::vector<unsigned char> skipped;
+
+  public:
+
+    I420Source(const std::string& path, int height, int width);
+
+    I420Source(const I420Source&) = delete;
+
+    I420Source& operator=(const I420Source&) = delete;
+
+    virtual ~I420Source();
+
+    virtual bool read(cv::Mat& frame);
+
+    virtual bool grab();
+
+    virtual cv::Mat allocate() const { return cv::Mat(height * 3 / 2, width, CV_8UC1); }
+
+    virtual int getHeight() const { return height; }
+
+    virtual int getWidth() const { return width; }
+
+    virtual size_t getFrameCount() const;
+
+    virtual void release();
+};
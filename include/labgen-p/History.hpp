@@ -19,13 +19,23 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <ostream>
 #include <sstream>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 #include <opencv2/core/core.hpp>
 
+#include "MappedFile.hpp"
+#include "MedianNetwork.hpp"
+#include "ThreadPool.hpp"
 #include "Utils.hpp"
 
 #define CHANNELS                                                              3
@@ -126,165 +136,1207 @@ inline bool operator==(const uint32_t& lhs, const HistoryMat& rhs) {
 }
 
 /* ========================================================================== *
- * History                                                                    *
+ * BaseHistory                                                                *
  * ========================================================================== */
 
-struct History {
-  typedef std::vector<HistoryMat>                                   HistoryVec;
+/*
+ * View on the history of a single ROI stored in the arena of a
+ * BasePatchesHistory. The samples are sorted by increasing number of
+ * positives, their color components being stored in CHANNELS consecutive
+ * planes of bufferSize bytes. The unused slots hold UNUSED_POSITIVES. The
+ * positives are stored as Key, which must hold all the quantities of motion.
+ */
+template <typename Key = uint32_t>
+struct BaseHistory {
+  static const Key UNUSED_POSITIVES = std::numeric_limits<Key>::max();
 
   /****************************************************************************/
 
-  HistoryVec history;
+  Key* positives;
+  uint8_t* colors;
+  uint32_t* count;
   size_t bufferSize;
 
   /****************************************************************************/
 
-  explicit History(size_t bufferSize) : history(), bufferSize(bufferSize) {
-    history.reserve(bufferSize + 1);
+  BaseHistory(
+    Key* positives,
+    uint8_t* colors,
+    uint32_t* count,
+    size_t bufferSize
+  ) :
+  positives(positives), colors(colors), count(count), bufferSize(bufferSize) {}
+
+  /****************************************************************************/
+
+  size_t size() const { return *count; }
+
+  /****************************************************************************/
+
+  HistoryMat operator[](size_t num) const {
+    const unsigned char mat[CHANNELS] = {
+      colors[num],
+      colors[bufferSize + num],
+      colors[2 * bufferSize + num]
+    };
+
+    return HistoryMat(mat, positives[num]);
   }
 
   /****************************************************************************/
 
-  HistoryVec& operator*() { return history; }
+  void median(unsigned char* result, size_t size = ~0) const {
+    size_t _size = std::min(static_cast<size_t>(*count), size);
+
+    if (_size == 0)
+      return;
+
+    for (size_t c = 0; c < CHANNELS; ++c)
+      result[c] = MedianNetwork::median(colors + c * bufferSize, _size);
+  }
+};
+
+/******************************************************************************/
+
+template <typename Key>
+const Key BaseHistory<Key>::UNUSED_POSITIVES;
+
+/* ========================================================================== *
+ * History                                                                    *
+ * ========================================================================== */
+
+/*
+ * Size of the buffer known at compile time. A new sample is inserted before
+ * the first one having at least as many positives, and the last sample is
+ * dropped when the buffer is full. The position is computed without any
+ * branch as the number of samples having less positives (the unused slots
+ * never do), over a loop of S iterations that is unrolled or vectorized.
+ */
+template <size_t S, typename Key = uint32_t>
+struct History : public BaseHistory<Key> {
+  using BaseHistory<Key>::positives;
+  using BaseHistory<Key>::colors;
+  using BaseHistory<Key>::count;
 
   /****************************************************************************/
 
-  const HistoryVec& operator*() const { return history; }
+  History(Key* positives, uint8_t* colors, uint32_t* count) :
+  BaseHistory<Key>(positives, colors, count, S) {}
 
   /****************************************************************************/
 
-  virtual void insert(const int32_t* probabilityMap, const unsigned char* frame) {
-    const int32_t* mapBuffer = probabilityMap;
-    int32_t positives = *(mapBuffer);
+  /* Returns true if the sample has been inserted. */
+  bool insert(const Key* probabilityMap, const unsigned char* frame) {
+    Key value = *probabilityMap;
+    size_t pos = 0;
 
-    if (history.empty())
-      history.push_back(HistoryMat(frame, positives));
-    else {
-      bool inserted = false;
+    for (size_t i = 0; i < S; ++i)
+      pos += (positives[i] < value);
 
-      for (
-        HistoryVec::iterator it = history.begin(), end = history.end();
-        it != end;
-        ++it
-      ) {
-        if (positives <= (*it)) {
-          history.insert(it, HistoryMat(frame, positives));
-          inserted = true;
+    /* More positives than all the samples of a full buffer. */
+    if (pos == S)
+      return false;
 
-          if (history.size() > bufferSize)
-            history.erase(history.end() - 1);
+    for (size_t i = S - 1; i > pos; --i)
+      positives[i] = positives[i - 1];
 
-          break;
-        }
-      }
+    positives[pos] = value;
+
+    for (size_t c = 0; c < CHANNELS; ++c) {
+      uint8_t* plane = colors + c * S;
 
-      if ((history.size() < bufferSize) && !inserted)
-        history.push_back(HistoryMat(frame, positives));
+      for (size_t i = S - 1; i > pos; --i)
+        plane[i] = plane[i - 1];
+
+      plane[pos] = frame[c];
     }
+
+    *count += (*count < S);
+
+    return true;
   }
+};
+
+/******************************************************************************/
+
+#define DYNAMIC_BUFFER_SIZE                                                   0
+
+/*
+ * Size of the buffer only known at runtime.
+ */
+template <typename Key>
+struct History<DYNAMIC_BUFFER_SIZE, Key> : public BaseHistory<Key> {
+  using BaseHistory<Key>::positives;
+  using BaseHistory<Key>::colors;
+  using BaseHistory<Key>::count;
+  using BaseHistory<Key>::bufferSize;
 
   /****************************************************************************/
 
-  virtual void median(unsigned char* result, size_t size = ~0) const {
-    if (history.size() == 1 || size == 1) {
-      result[0] = history[0].mat[0];
-      result[1] = history[0].mat[1];
-      result[2] = history[0].mat[2];
-    }
+  History(
+    Key* positives,
+    uint8_t* colors,
+    uint32_t* count,
+    size_t bufferSize
+  ) :
+  BaseHistory<Key>(positives, colors, count, bufferSize) {}
+
+  /****************************************************************************/
+
+  /* Returns true if the sample has been inserted. */
+  bool insert(const Key* probabilityMap, const unsigned char* frame) {
+    Key positives = *probabilityMap;
+    size_t _count = *count;
+
+    size_t pos = 0;
+
+    while (pos < _count && this->positives[pos] < positives)
+      ++pos;
 
-    std::vector<unsigned char> bufferR(bufferSize);
-    std::vector<unsigned char> bufferG(bufferSize);
-    std::vector<unsigned char> bufferB(bufferSize);
+    if (pos == bufferSize)
+      return false;
 
-    size_t _size = std::min(history.size(), size);
+    size_t last = (_count < bufferSize) ? _count : (bufferSize - 1);
 
-    for (size_t num = 0; num < _size; ++num) {
-      bufferR[num] = history[num].mat[0];
-      bufferG[num] = history[num].mat[1];
-      bufferB[num] = history[num].mat[2];
+    for (size_t c = 0; c < CHANNELS; ++c) {
+      uint8_t* plane = colors + c * bufferSize;
+
+      std::copy_backward(plane + pos, plane + last, plane + last + 1);
+      plane[pos] = frame[c];
     }
 
-    size_t middle = _size / 2;
+    std::copy_backward(
+      this->positives + pos,
+      this->positives + last,
+      this->positives + last + 1
+    );
+
+    this->positives[pos] = positives;
+
+    if (_count < bufferSize)
+      ++(*count);
+
+    return true;
+  }
+};
 
-    if (_size & 1) {
-      std::nth_element(bufferR.begin(), bufferR.begin() + middle, bufferR.begin() + _size);
-      std::nth_element(bufferG.begin(), bufferG.begin() + middle, bufferG.begin() + _size);
-      std::nth_element(bufferB.begin(), bufferB.begin() + middle, bufferB.begin() + _size);
+/* ========================================================================== *
+ * BasePatchesHistory                                                         *
+ * ========================================================================== */
+
+/*
+ * The histories of all the ROIs share a single arena made of four planes:
+ * the number of positives of every sample (rois.size() x bufferSize), the
+ * colors of every sample for each pixel (pixels x CHANNELS x bufferSize), the
+ * number of samples stored for each pixel, and a flag per pixel raised when
+ * its history is modified. The histories of neighbouring pixels are thus
+ * contiguous in memory, and the whole structure is allocated at once.
+ *
+ * At pixel level, each ROI is a pixel. Otherwise, the samples of a patch are
+ * selected at once from the mean quantity of motion over the patch, and all
+ * the pixels of the patch share the positives of the patch. There are then
+ * far fewer positives to store and to compare, the colors and the medians
+ * remaining those of the pixels.
+ *
+ * The dirty flags accumulate the modifications until updateMedian() is
+ * called, which recomputes the medians of the modified pixels only.
+ *
+ * A fifth plane holds the positives of the last sample of each ROI, the
+ * largest ones it retains, or UNUSED_POSITIVES while it is not full. A sample
+ * having more positives is rejected, so that the insertion first compares
+ * blocks of MedianNetwork::LANES quantities of motion with this contiguous
+ * plane, and only goes through the histories of the blocks where a sample is
+ * accepted.
+ *
+ * Given a thread pool, the histories are updated and their medians computed
+ * over ranges of ROIs or pixels processed concurrently, the ranges of medians
+ * being made of whole blocks of MedianNetwork::LANES pixels.
+ *
+ * The positives are stored on keySize bytes, the operations depending on them
+ * being implemented by KeyedPatchesHistory.
+ *
+ * Given a backing folder, the arena is a MappedScratch in that folder rather
+ * than memory, so that the histories of the pixels not being updated can be
+ * paged out to the disk when they do not fit in memory.
+ */
+struct BasePatchesHistory {
+  /* Alignment of the planes in the arena, in bytes. */
+  static const size_t ALIGNMENT = 64;
+
+  /* Largest buffer size having a specialized implementation. */
+  static const size_t MAX_FIXED_BUFFER_SIZE = 32;
+
+  /****************************************************************************/
+
+  const Utils::ROIs rois;
+  size_t pixels;
+  size_t bufferSize;
+  size_t keySize;
+  ThreadPool* pool;
 
-      result[0] = bufferR[middle];
-      result[1] = bufferG[middle];
-      result[2] = bufferB[middle];
+  std::vector<uint8_t> arena;
+  std::unique_ptr<MappedScratch> mappedArena;
+  uint8_t* keys;
+  uint8_t* worst;
+  uint8_t* colors;
+  uint32_t* counts;
+  uint8_t* dirty;
+
+  /****************************************************************************/
+
+  BasePatchesHistory(
+    const Utils::ROIs& rois,
+    size_t bufferSize,
+    size_t keySize,
+    ThreadPool* pool = NULL,
+    const std::string& backing = ""
+  ) :
+    rois(rois), pixels(rois.height * rois.width), bufferSize(bufferSize),
+    keySize(keySize), pool(pool), arena(), mappedArena(),
+    keys(NULL), worst(NULL), colors(NULL), counts(NULL), dirty(NULL) {
+
+    size_t keysBytes   = align(rois.size() * bufferSize * keySize);
+    size_t worstBytes  = align(rois.size() * keySize);
+    size_t countsBytes = align(pixels * sizeof(uint32_t));
+    size_t dirtyBytes  = align(pixels);
+
+    size_t arenaSize = getArenaSize(rois, bufferSize, keySize);
+    uint8_t* data = NULL;
+
+    if (backing.empty()) {
+      arena.resize(arenaSize);
+      data = arena.data();
     }
     else {
-      std::nth_element(bufferR.begin(), bufferR.begin() + (middle - 1), bufferR.begin() + _size);
-      std::nth_element(bufferG.begin(), bufferG.begin() + (middle - 1), bufferG.begin() + _size);
-      std::nth_element(bufferB.begin(), bufferB.begin() + (middle - 1), bufferB.begin() + _size);
+      mappedArena.reset(new MappedScratch(backing, arenaSize));
+      data = mappedArena->getData();
+    }
+
+    uint8_t* base = reinterpret_cast<uint8_t*>(
+      align(reinterpret_cast<uintptr_t>(data))
+    );
+
+    keys   = base;
+    worst  = base + keysBytes;
+    counts = reinterpret_cast<uint32_t*>(base + keysBytes + worstBytes);
+    dirty  = base + keysBytes + worstBytes + countsBytes;
+    colors = base + keysBytes + worstBytes + countsBytes + dirtyBytes;
+
+    std::fill(counts, counts + pixels, 0);
+    std::fill(dirty, dirty + pixels, 0);
+  }
+
+  /****************************************************************************/
 
-      std::nth_element(bufferR.begin() + middle, bufferR.begin() + middle, bufferR.begin() + _size);
-      std::nth_element(bufferG.begin() + middle, bufferG.begin() + middle, bufferG.begin() + _size);
-      std::nth_element(bufferB.begin() + middle, bufferB.begin() + middle, bufferB.begin() + _size);
+  BasePatchesHistory(const BasePatchesHistory&) = delete;
 
-      result[0] = (((int)bufferR[middle - 1]) + ((int)bufferR[middle])) / 2;
-      result[1] = (((int)bufferG[middle - 1]) + ((int)bufferG[middle])) / 2;
-      result[2] = (((int)bufferB[middle - 1]) + ((int)bufferB[middle])) / 2;
+  /****************************************************************************/
+
+  BasePatchesHistory& operator=(const BasePatchesHistory&) = delete;
+
+  /****************************************************************************/
+
+  virtual ~BasePatchesHistory() {}
+
+  /****************************************************************************/
+
+  /*
+   * Instantiates the specialized implementation matching bufferSize if any,
+   * or the dynamic one otherwise. The positives are stored on 16 bits for
+   * CV_16UC1 quantities of motion, and on 32 bits for CV_32SC1 ones. The
+   * arena is in memory, unless a backing folder is given.
+   */
+  static std::shared_ptr<BasePatchesHistory> create(
+    const Utils::ROIs& rois,
+    size_t bufferSize,
+    ThreadPool* pool = NULL,
+    int encoding = CV_32SC1,
+    const std::string& backing = ""
+  );
+
+  /****************************************************************************/
+
+  /*
+   * Size of the arena of a history, in bytes. The medians may read up to
+   * MedianNetwork::LANES bytes past the colors.
+   */
+  static size_t getArenaSize(
+    const Utils::ROIs& rois,
+    size_t bufferSize,
+    size_t keySize = sizeof(uint32_t)
+  ) {
+    size_t pixels = rois.height * rois.width;
+
+    return
+      align(rois.size() * bufferSize * keySize) +
+      align(rois.size() * keySize) +
+      align(pixels * sizeof(uint32_t)) +
+      align(pixels) +
+      align(pixels * CHANNELS * bufferSize) +
+      ALIGNMENT +
+      MedianNetwork::LANES;
+  }
+
+  /****************************************************************************/
+
+  /*
+   * Empties all the histories, so that the structure can be reused for
+   * another sequence having the same ROIs.
+   */
+  virtual void clear() = 0;
+
+  /****************************************************************************/
+
+  /*
+   * Size of the state written by save(), in bytes: the positives, the counts
+   * and the colors planes, the dirty flags being left out.
+   */
+  size_t getStateSize() const {
+    return
+      rois.size() * bufferSize * keySize +
+      pixels * sizeof(uint32_t) +
+      pixels * CHANNELS * bufferSize;
+  }
+
+  /****************************************************************************/
+
+  void save(std::ostream& stream) const {
+    stream.write(
+      reinterpret_cast<const char*>(keys),
+      rois.size() * bufferSize * keySize
+    );
+
+    stream.write(
+      reinterpret_cast<const char*>(counts),
+      pixels * sizeof(uint32_t)
+    );
+
+    stream.write(
+      reinterpret_cast<const char*>(colors),
+      pixels * CHANNELS * bufferSize
+    );
+  }
+
+  /****************************************************************************/
+
+  /*
+   * Throws a runtime_error if getStateSize() bytes written by save() for the
+   * same ROIs, buffer size, and size of the positives are not consistent, as
+   * in a corrupt file: the positives of each ROI must be sorted and followed
+   * by UNUSED_POSITIVES only, and the count of each of its pixels must be the
+   * number of used positives.
+   */
+  virtual void check(const uint8_t* state) const = 0;
+
+  /****************************************************************************/
+
+  /*
+   * Restores getStateSize() bytes written by save() for the same ROIs, buffer
+   * size, and size of the positives, once checked by check(). All the pixels
+   * are considered as modified.
+   */
+  void load(const uint8_t* state) {
+    size_t keysBytes   = rois.size() * bufferSize * keySize;
+    size_t countsBytes = pixels * sizeof(uint32_t);
+
+    check(state);
+
+    std::memcpy(keys, state, keysBytes);
+    std::memcpy(counts, state + keysBytes, countsBytes);
+    std::memcpy(
+      colors,
+      state + keysBytes + countsBytes,
+      pixels * CHANNELS * bufferSize
+    );
+
+    updateWorst(0, rois.size());
+    std::fill(dirty, dirty + pixels, 1);
+  }
+
+  /****************************************************************************/
+
+  /*
+   * Copies the positives of the last sample of the ROIs [begin, end) into the
+   * plane of the worst positives.
+   */
+  void updateWorst(size_t begin, size_t end) {
+    for (size_t roi = begin; roi < end; ++roi) {
+      std::memcpy(
+        worst + roi * keySize,
+        keys + ((roi + 1) * bufferSize - 1) * keySize,
+        keySize
+      );
     }
   }
+
+  /****************************************************************************/
+
+  /*
+   * Adds amount to the positives of all the stored samples, so that the older
+   * a sample, the sooner it is replaced. The order of the samples, and thus
+   * the medians, are unchanged. The positives saturate just below
+   * UNUSED_POSITIVES.
+   */
+  virtual void age(uint32_t amount) = 0;
+
+  /****************************************************************************/
+
+  /*
+   * Returns the number of pixels whose history has been modified. The
+   * quantities of motion must have the encoding given to create().
+   */
+  virtual size_t insert(const cv::Mat& probabilityMap, const cv::Mat& frame) = 0;
+
+  /****************************************************************************/
+
+  /*
+   * Inserts at pixel level the samples of the pixels [begin, end), whose
+   * quantities of motion, of the encoding given to create(), and colors start
+   * at the given pointers. Consecutive ranges, such as rows, can thus be
+   * inserted as soon as their quantities of motion are computed. Returns the
+   * number of pixels whose history has been modified.
+   */
+  virtual size_t insertPixels(
+    const void* quantities,
+    const uint8_t* colors,
+    size_t begin,
+    size_t end
+  ) = 0;
+
+  /****************************************************************************/
+
+  /*
+   * Merges into this history the one of a later part of the same sequence,
+   * having the same ROIs, buffer size, and size of the positives. Since a
+   * history holds the samples having the fewest positives, a later sample
+   * going first among equals, the result is the history that the whole
+   * sequence would have produced. Returns the number of pixels whose history
+   * has been modified.
+   */
+  virtual size_t merge(const BasePatchesHistory& newer) = 0;
+
+  /****************************************************************************/
+
+  /*
+   * The medians are computed MedianNetwork::LANES pixels at a time when they
+   * hold the same number of samples, which is the case once the buffers are
+   * full, and one pixel at a time otherwise.
+   */
+  virtual void median(cv::Mat& result, size_t size = ~0) const {
+    uint8_t* data = result.data;
+
+    ThreadPool::run(pool, 0, pixels, [&](size_t begin, size_t end) {
+      median(data, size, begin, end);
+    }, MedianNetwork::LANES);
+  }
+
+  /****************************************************************************/
+
+  /*
+   * Medians of the pixels [begin, end) written in the interleaved result
+   * buffer.
+   */
+  void median(uint8_t* result, size_t size, size_t begin, size_t end) const {
+    const size_t LANES = MedianNetwork::LANES;
+    const size_t pixelStride = CHANNELS * bufferSize;
+
+    size_t num = begin;
+
+    for (; num + LANES <= end; num += LANES) {
+      size_t n = std::min(static_cast<size_t>(counts[num]), size);
+      bool uniform = (n > 0) && (bufferSize <= MedianNetwork::MAX_SIZE);
+
+      for (size_t i = 1; uniform && i < LANES; ++i)
+        uniform = (std::min(static_cast<size_t>(counts[num + i]), size) == n);
+
+      if (uniform) {
+        MedianNetwork::median(
+          colors + num * pixelStride,
+          pixelStride,
+          bufferSize,
+          CHANNELS,
+          n,
+          result + num * CHANNELS
+        );
+      }
+      else {
+        for (size_t i = num; i < num + LANES; ++i)
+          median(i, result + i * CHANNELS, size);
+      }
+    }
+
+    for (; num < end; ++num)
+      median(num, result + num * CHANNELS, size);
+  }
+
+  /****************************************************************************/
+
+  /* Median of the pixel num, see BaseHistory::median(). */
+  void median(size_t num, uint8_t* result, size_t size) const {
+    size_t n = std::min(static_cast<size_t>(counts[num]), size);
+
+    if (n == 0)
+      return;
+
+    const uint8_t* pixelColors = colors + num * CHANNELS * bufferSize;
+
+    for (size_t c = 0; c < CHANNELS; ++c)
+      result[c] = MedianNetwork::median(pixelColors + c * bufferSize, n);
+  }
+
+  /****************************************************************************/
+
+  /*
+   * Updates result with the medians of the pixels modified since the previous
+   * call, and clears their dirty flags. The blocks of MedianNetwork::LANES
+   * pixels without any modification are skipped at once.
+   */
+  void updateMedian(cv::Mat& result, size_t size = ~0) {
+    updateMedian(result, size, [](size_t, size_t) {});
+  }
+
+  /****************************************************************************/
+
+  /*
+   * Same as updateMedian(), also calling visit(begin, end) over the ranges of
+   * consecutive pixels recomputed, from the thread that recomputed them.
+   */
+  void updateMedian(cv::Mat& result, size_t size, const ThreadPool::Body& visit) {
+    uint8_t* data = result.data;
+
+    ThreadPool::run(pool, 0, pixels, [&](size_t begin, size_t end) {
+      updateMedian(data, size, begin, end, visit);
+    }, MedianNetwork::LANES);
+  }
+
+  /****************************************************************************/
+
+  void updateMedian(
+    uint8_t* result,
+    size_t size,
+    size_t begin,
+    size_t end,
+    const ThreadPool::Body& visit
+  ) {
+    const size_t LANES = MedianNetwork::LANES;
+    const uint8_t clean[LANES] = { 0 };
+
+    /* First pixel of the range being recomputed. */
+    size_t first = begin;
+    size_t num = begin;
+
+    for (; num + LANES <= end; num += LANES) {
+      if (std::memcmp(dirty + num, clean, LANES) == 0) {
+        if (first < num)
+          visit(first, num);
+
+        first = num + LANES;
+        continue;
+      }
+
+      median(result, size, num, num + LANES);
+      std::fill(dirty + num, dirty + num + LANES, 0);
+    }
+
+    for (; num < end; ++num) {
+      if (!dirty[num]) {
+        if (first < num)
+          visit(first, num);
+
+        first = num + 1;
+        continue;
+      }
+
+      median(num, result + num * CHANNELS, size);
+      dirty[num] = 0;
+    }
+
+    if (first < end)
+      visit(first, end);
+  }
+
+  /****************************************************************************/
+
+  static size_t align(size_t size) {
+    return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+  }
 };
 
 /* ========================================================================== *
- * PatchesHistory                                                             *
+ * KeyedPatchesHistory                                                        *
  * ========================================================================== */
 
-struct PatchesHistory {
-  typedef std::vector<History>                 PatchesHistoryVec;
+/*
+ * Operations of a BasePatchesHistory depending on the positives, stored as
+ * Key. For a 32-bit Key, the quantities of motion are CV_32SC1 matrices read
+ * as unsigned values.
+ */
+template <typename Key>
+struct KeyedPatchesHistory : public BasePatchesHistory {
+  static const Key UNUSED_POSITIVES = BaseHistory<Key>::UNUSED_POSITIVES;
+
+  /****************************************************************************/
+
+  Key* positives;
+  Key* worstPositives;
+
+  /****************************************************************************/
+
+  KeyedPatchesHistory(
+    const Utils::ROIs& rois,
+    size_t bufferSize,
+    ThreadPool* pool = NULL,
+    const std::string& backing = ""
+  ) :
+    BasePatchesHistory(rois, bufferSize, sizeof(Key), pool, backing),
+    positives(reinterpret_cast<Key*>(keys)),
+    worstPositives(reinterpret_cast<Key*>(worst)) {
+
+    clear();
+  }
+
+  /****************************************************************************/
+
+  virtual void clear() {
+    std::fill(
+      positives,
+      positives + rois.size() * bufferSize,
+      UNUSED_POSITIVES
+    );
+
+    std::fill(worstPositives, worstPositives + rois.size(), UNUSED_POSITIVES);
+    std::fill(counts, counts + pixels, 0);
+    std::fill(dirty, dirty + pixels, 0);
+  }
+
+  /****************************************************************************/
+
+  virtual void check(const uint8_t* state) const {
+    const uint8_t* statePositives = state;
+    const uint8_t* stateCounts = state + rois.size() * bufferSize * sizeof(Key);
+
+    /* The state may not be aligned on the positives. */
+    std::vector<Key> roiPositives(bufferSize);
+
+    for (size_t num = 0; num < rois.size(); ++num) {
+      std::memcpy(
+        roiPositives.data(),
+        statePositives + num * bufferSize * sizeof(Key),
+        bufferSize * sizeof(Key)
+      );
+
+      size_t used =
+        std::find(roiPositives.begin(), roiPositives.end(), UNUSED_POSITIVES) -
+        roiPositives.begin();
+
+      bool valid =
+        std::is_sorted(roiPositives.begin(), roiPositives.begin() + used) &&
+        std::count(roiPositives.begin() + used, roiPositives.end(), UNUSED_POSITIVES) ==
+          static_cast<std::ptrdiff_t>(bufferSize - used);
+
+      cv::Rect rect = rois[num];
+
+      for (int y = rect.y; valid && y < rect.y + rect.height; ++y) {
+        for (int x = rect.x; valid && x < rect.x + rect.width; ++x) {
+          uint32_t count;
+          std::memcpy(
+            &count,
+            stateCounts + (y * rois.width + x) * sizeof(uint32_t),
+            sizeof(uint32_t)
+          );
+
+          valid = (count == used);
+        }
+      }
+
+      if (!valid)
+        throw std::runtime_error("The state of the histories is corrupt!");
+    }
+  }
+
+  /****************************************************************************/
+
+  virtual void age(uint32_t amount) {
+    const Key LIMIT = UNUSED_POSITIVES - 1;
+    const Key step = static_cast<Key>(std::min<uint32_t>(amount, LIMIT));
+    const Key threshold = LIMIT - step;
+
+    Key* data = positives;
+    Key* worstData = worstPositives;
+    size_t size = bufferSize;
+
+    /* The worst positives are aged along with the positives they copy. */
+    ThreadPool::run(pool, 0, rois.size(), [=](size_t begin, size_t end) {
+      for (size_t i = begin * size; i < end * size; ++i)
+        data[i] = getAged(data[i], step, threshold);
+
+      for (size_t i = begin; i < end; ++i)
+        worstData[i] = getAged(worstData[i], step, threshold);
+    });
+  }
+
+  /****************************************************************************/
+
+  static Key getAged(Key value, Key step, Key threshold) {
+    return
+      (value == UNUSED_POSITIVES) ? value :
+      (value < threshold) ? static_cast<Key>(value + step) : UNUSED_POSITIVES - 1;
+  }
 
   /****************************************************************************/
 
-  PatchesHistoryVec pHistory;
-  const Utils::ROIs& rois;
+  /*
+   * Whether one of the MedianNetwork::LANES samples starting at probaData can
+   * enter its history, having at most the worst positives of the history.
+   * The comparisons have no branch, so that they are vectorized.
+   */
+  static bool getAnyAccepted(const Key* probaData, const Key* worst) {
+    Key accepted = 0;
+
+    for (size_t k = 0; k < MedianNetwork::LANES; ++k)
+      accepted |= static_cast<Key>(probaData[k] <= worst[k]);
+
+    return accepted != 0;
+  }
 
   /****************************************************************************/
 
-  PatchesHistory(const Utils::ROIs& rois, size_t bufferSize) :
-    pHistory(), rois(rois) {
+  /*
+   * History of the pixel num, whose positives are the ones of its ROI.
+   */
+  BaseHistory<Key> operator[](size_t num) const {
+    size_t roi =
+      rois.isPixelLevel() ? num : rois.getIndex(num / rois.width, num % rois.width);
+
+    return BaseHistory<Key>(
+      positives + roi * bufferSize,
+      colors + num * CHANNELS * bufferSize,
+      counts + num,
+      bufferSize
+    );
+  }
+
+  /****************************************************************************/
+
+  virtual size_t insert(const cv::Mat& probabilityMap, const cv::Mat& frame) {
+    if (probabilityMap.elemSize() != sizeof(Key))
+      throw std::logic_error("The quantities of motion do not match the history");
+
+    const Key* probaData = reinterpret_cast<const Key*>(probabilityMap.data);
+    const uint8_t* frameData = frame.data;
+
+    std::atomic<size_t> modified(0);
 
-    pHistory.reserve(rois.size());
+    ThreadPool::run(pool, 0, rois.size(), [&](size_t begin, size_t end) {
+      if (rois.isPixelLevel())
+        modified += insert(probaData + begin, frameData + begin * CHANNELS, begin, end);
+      else
+        modified += insertPatches(probabilityMap, frame, begin, end);
+    });
 
-    for (size_t i = 0; i < rois.size(); ++i)
-      pHistory.push_back(History(bufferSize));
+    return modified;
   }
 
   /****************************************************************************/
 
-  PatchesHistory(const Utils::ROIs& rois, std::vector<size_t> bufferSize) :
-    pHistory(), rois(rois) {
+  virtual size_t insertPixels(
+    const void* quantities,
+    const uint8_t* colors,
+    size_t begin,
+    size_t end
+  ) {
+    if (!rois.isPixelLevel())
+      throw std::logic_error("Only pixel-level histories insert pixels");
 
-    pHistory.reserve(rois.size());
+    return insert(static_cast<const Key*>(quantities), colors, begin, end);
+  }
+
+  /****************************************************************************/
+
+  virtual size_t merge(const BasePatchesHistory& newer) {
+    const KeyedPatchesHistory<Key>* keyed =
+      dynamic_cast<const KeyedPatchesHistory<Key>*>(&newer);
+
+    if (
+      keyed == NULL ||
+      newer.rois.height != rois.height || newer.rois.width != rois.width ||
+      newer.rois.rows != rois.rows || newer.rois.cols != rois.cols ||
+      newer.bufferSize != bufferSize
+    )
+      throw std::logic_error("Only histories of the same shape can be merged");
 
-    for (size_t i = 0; i < rois.size(); ++i)
-      pHistory.push_back(History(bufferSize[i]));
+    std::atomic<size_t> modified(0);
+
+    ThreadPool::run(pool, 0, rois.size(), [&](size_t begin, size_t end) {
+      modified += merge(*keyed, begin, end);
+    });
+
+    return modified;
   }
 
   /****************************************************************************/
 
-  virtual void insert(const cv::Mat& probabilityMap, const cv::Mat& frame) {
-    int32_t* probaData = reinterpret_cast<int32_t*>(probabilityMap.data);
-    unsigned char* frameData = frame.data;
+  /* Merges the histories of the ROIs [begin, end). */
+  size_t merge(const KeyedPatchesHistory<Key>& newer, size_t begin, size_t end) {
+    std::vector<Key> mergedPositives(bufferSize);
+    std::vector<uint8_t> mergedColors(bufferSize);
+
+    /* Index of each merged sample, offset by bufferSize if it is a later one. */
+    std::vector<size_t> sources(bufferSize);
+
+    size_t modified = 0;
+
+    for (size_t num = begin; num < end; ++num) {
+      Key* older = positives + num * bufferSize;
+      const Key* later = newer.positives + num * bufferSize;
+
+      /* The unused samples are the last ones. */
+      size_t olderCount =
+        std::find(older, older + bufferSize, UNUSED_POSITIVES) - older;
+      size_t laterCount =
+        std::find(later, later + bufferSize, UNUSED_POSITIVES) - later;
+
+      if (laterCount == 0)
+        continue;
+
+      size_t i = 0;
+      size_t j = 0;
+      size_t k = 0;
+
+      for (; k < bufferSize && (i < olderCount || j < laterCount); ++k) {
+        if (j < laterCount && (i == olderCount || later[j] <= older[i])) {
+          mergedPositives[k] = later[j];
+          sources[k] = bufferSize + j++;
+        }
+        else {
+          mergedPositives[k] = older[i];
+          sources[k] = i++;
+        }
+      }
+
+      /* Nothing has been taken from the later history. */
+      if (j == 0)
+        continue;
+
+      std::copy(mergedPositives.begin(), mergedPositives.begin() + k, older);
+      worstPositives[num] = older[bufferSize - 1];
+
+      cv::Rect rect = rois[num];
+
+      for (int y = rect.y; y < rect.y + rect.height; ++y) {
+        for (int x = rect.x; x < rect.x + rect.width; ++x) {
+          size_t pixel = y * rois.width + x;
+
+          for (size_t c = 0; c < CHANNELS; ++c) {
+            size_t offset = (pixel * CHANNELS + c) * bufferSize;
+
+            uint8_t* plane = colors + offset;
+            const uint8_t* laterPlane = newer.colors + offset;
+
+            for (size_t s = 0; s < k; ++s) {
+              mergedColors[s] = (sources[s] < bufferSize) ?
+                plane[sources[s]] : laterPlane[sources[s] - bufferSize];
+            }
+
+            std::copy(mergedColors.begin(), mergedColors.begin() + k, plane);
+          }
+
+          counts[pixel] = k;
+          dirty[pixel] = 1;
+        }
+      }
+
+      modified += rect.area();
+    }
 
-    for (int i = 0, j = 0; i < frame.rows * frame.cols; ++i, j += 3) {
-      pHistory[i].insert(
-        probaData + i,
-        frameData + j
+    return modified;
+  }
+
+  /****************************************************************************/
+
+  /*
+   * Inserts the samples of the patches [begin, end). A patch is scored by the
+   * mean of the quantities of motion over its pixels, and its sample is
+   * inserted like the one of a pixel, the colors of all its pixels being
+   * shifted at the same position.
+   */
+  size_t insertPatches(
+    const cv::Mat& probabilityMap,
+    const cv::Mat& frame,
+    size_t begin,
+    size_t end
+  ) {
+    size_t modified = 0;
+
+    for (size_t num = begin; num < end; ++num) {
+      cv::Rect rect = rois[num];
+
+      if (rect.area() == 0)
+        continue;
+
+      uint64_t sum = 0;
+
+      for (int y = rect.y; y < rect.y + rect.height; ++y) {
+        const Key* row = probabilityMap.ptr<Key>(y);
+
+        for (int x = rect.x; x < rect.x + rect.width; ++x)
+          sum += row[x];
+      }
+
+      Key value = static_cast<Key>(sum / rect.area());
+
+      /* Before the first sample having at least as many positives. */
+      Key* patchPositives = positives + num * bufferSize;
+      size_t pos =
+        std::lower_bound(patchPositives, patchPositives + bufferSize, value) -
+        patchPositives;
+
+      if (pos == bufferSize)
+        continue;
+
+      std::copy_backward(
+        patchPositives + pos,
+        patchPositives + bufferSize - 1,
+        patchPositives + bufferSize
       );
+
+      patchPositives[pos] = value;
+      worstPositives[num] = patchPositives[bufferSize - 1];
+
+      for (int y = rect.y; y < rect.y + rect.height; ++y) {
+        const uint8_t* input = frame.ptr<uint8_t>(y) + rect.x * CHANNELS;
+
+        for (int x = rect.x; x < rect.x + rect.width; ++x, input += CHANNELS) {
+          size_t i = y * rois.width + x;
+          uint8_t* pixelColors = colors + i * CHANNELS * bufferSize;
+
+          for (size_t c = 0; c < CHANNELS; ++c) {
+            uint8_t* plane = pixelColors + c * bufferSize;
+
+            std::copy_backward(
+              plane + pos,
+              plane + bufferSize - 1,
+              plane + bufferSize
+            );
+
+            plane[pos] = input[c];
+          }
+
+          counts[i] += (counts[i] < bufferSize);
+          dirty[i] = 1;
+        }
+      }
+
+      modified += rect.area();
     }
+
+    return modified;
   }
 
   /****************************************************************************/
 
-  virtual void median(cv::Mat& result, size_t size = ~0) const {
-    unsigned char* data = result.data;
+  /*
+   * Inserts the samples of the pixels [begin, end) at pixel level, whose
+   * quantities of motion and colors start at probaData and frameData, returns
+   * the number of modified histories.
+   */
+  virtual size_t insert(
+    const Key* probaData,
+    const uint8_t* frameData,
+    size_t begin,
+    size_t end
+  ) = 0;
+};
+
+/******************************************************************************/
+
+template <typename Key>
+const Key KeyedPatchesHistory<Key>::UNUSED_POSITIVES;
+
+/* ========================================================================== *
+ * PatchesHistory                                                             *
+ * ========================================================================== */
+
+template <size_t S, typename Key = uint32_t>
+struct PatchesHistory : public KeyedPatchesHistory<Key> {
+  explicit PatchesHistory(
+    const Utils::ROIs& rois,
+    ThreadPool* pool = NULL,
+    const std::string& backing = ""
+  ) :
+    KeyedPatchesHistory<Key>(rois, S, pool, backing) {}
+
+  /****************************************************************************/
+
+  using KeyedPatchesHistory<Key>::insert;
+
+  virtual size_t insert(
+    const Key* probaData,
+    const uint8_t* frameData,
+    size_t begin,
+    size_t end
+  ) {
+    const size_t LANES = MedianNetwork::LANES;
+
+    Key* worst = this->worstPositives;
+    size_t modified = 0;
+
+    for (size_t i = begin; i < end;) {
+      /* Blocks of samples all rejected by their histories. */
+      if (i + LANES <= end && !this->getAnyAccepted(probaData, worst + i)) {
+        i += LANES;
+        probaData += LANES;
+        frameData += LANES * CHANNELS;
 
-    for (size_t i = 0, j = 0; i < rois.size(); ++i, j += 3)
-      pHistory[i].median(data + j, size);
+        continue;
+      }
+
+      size_t blockEnd = std::min(i + LANES, end);
+
+      for (; i < blockEnd; ++i, ++probaData, frameData += CHANNELS) {
+        bool inserted = History<S, Key>(
+          this->positives + i * S,
+          this->colors + i * CHANNELS * S,
+          this->counts + i
+        ).insert(probaData, frameData);
+
+        worst[i] = this->positives[i * S + S - 1];
+        this->dirty[i] |= inserted;
+        modified += inserted;
+      }
+    }
+
+    return modified;
+  }
+};
+
+/******************************************************************************/
+
+template <typename Key>
+struct PatchesHistory<DYNAMIC_BUFFER_SIZE, Key> : public KeyedPatchesHistory<Key> {
+  PatchesHistory(
+    const Utils::ROIs& rois,
+    size_t bufferSize,
+    ThreadPool* pool = NULL,
+    const std::string& backing = ""
+  ) :
+    KeyedPatchesHistory<Key>(rois, bufferSize, pool, backing) {}
+
+  /****************************************************************************/
+
+  using KeyedPatchesHistory<Key>::insert;
+
+  virtual size_t insert(
+    const Key* probaData,
+    const uint8_t* frameData,
+    size_t begin,
+    size_t end
+  ) {
+    const size_t LANES = MedianNetwork::LANES;
+
+    size_t bufferSize = this->bufferSize;
+    Key* worst = this->worstPositives;
+    size_t modified = 0;
+
+    for (size_t i = begin; i < end;) {
+      /* Blocks of samples all rejected by their histories. */
+      if (i + LANES <= end && !this->getAnyAccepted(probaData, worst + i)) {
+        i += LANES;
+        probaData += LANES;
+        frameData += LANES * CHANNELS;
+
+        continue;
+      }
+
+      size_t blockEnd = std::min(i + LANES, end);
+
+      for (; i < blockEnd; ++i, ++probaData, frameData += CHANNELS) {
+        bool inserted = History<DYNAMIC_BUFFER_SIZE, Key>(
+          this->positives + i * bufferSize,
+          this->colors + i * CHANNELS * bufferSize,
+          this->counts + i,
+          bufferSize
+        ).insert(probaData, frameData);
+
+        worst[i] = this->positives[(i + 1) * bufferSize - 1];
+        this->dirty[i] |= inserted;
+        modified += inserted;
+      }
+    }
+
+    return modified;
+  }
+};
+
+/* ========================================================================== *
+ * PatchesHistoryFactory                                                      *
+ * ========================================================================== */
+
+/*
+ * Walks down the specialized buffer sizes from S to 1 at runtime.
+ */
+template <size_t S, typename Key>
+struct PatchesHistoryFactory {
+  static std::shared_ptr<BasePatchesHistory> create(
+    const Utils::ROIs& rois,
+    size_t bufferSize,
+    ThreadPool* pool,
+    const std::string& backing
+  ) {
+    if (bufferSize == S)
+      return std::make_shared<PatchesHistory<S, Key> >(rois, pool, backing);
+
+    return PatchesHistoryFactory<S - 1, Key>::create(rois, bufferSize, pool, backing);
+  }
+};
+
+/******************************************************************************/
+
+template <typename Key>
+struct PatchesHistoryFactory<DYNAMIC_BUFFER_SIZE, Key> {
+  static std::shared_ptr<BasePatchesHistory> create(
+    const Utils::ROIs& rois,
+    size_t bufferSize,
+    ThreadPool* pool,
+    const std::string& backing
+  ) {
+    return std::make_shared<PatchesHistory<DYNAMIC_BUFFER_SIZE, Key> >(
+      rois,
+      bufferSize,
+      pool,
+      backing
+    );
   }
 };
+
+/******************************************************************************/
+
+inline std::shared_ptr<BasePatchesHistory> BasePatchesHistory::create(
+  const Utils::ROIs& rois,
+  size_t bufferSize,
+  ThreadPool* pool,
+  int encoding,
+  const std::string& backing
+) {
+  if (bufferSize == 0)
+    throw std::logic_error("The size of the buffer must be positive");
+
+  switch (encoding) {
+    case CV_16UC1:
+      return PatchesHistoryFactory<MAX_FIXED_BUFFER_SIZE, uint16_t>::create(
+        rois,
+        bufferSize,
+        pool,
+        backing
+      );
+    case CV_32SC1:
+      return PatchesHistoryFactory<MAX_FIXED_BUFFER_SIZE, uint32_t>::create(
+        rois,
+        bufferSize,
+        pool,
+        backing
+      );
+    default:
+      throw std::logic_error("Unsupported encoding of the quantities of motion");
+  }
+}
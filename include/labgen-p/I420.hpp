@@ -0,0 +1,64 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <opencv2/core/core.hpp>
+
+#include "ThreadPool.hpp"
+
+/* ========================================================================== *
+ * I420                                                                       *
+ * ========================================================================== */
+
+/*
+ * Planar YUV 4:2:0 frames, as CV_8UC1 matrices of 3 * height / 2 rows of the
+ * same layout as the ones of cv::cvtColor(CV_YUV2BGR_I420): the Y plane, then
+ * the U and the V planes subsampled by 2 along both dimensions. The height
+ * and the width of the frames are thus even.
+ */
+struct I420 {
+  /* Height of the frames held by a matrix of the given number of rows. */
+  static int getHeight(int rows) {
+    return rows * 2 / 3;
+  }
+
+  /* The Y plane of a frame, without any copy. */
+  static cv::Mat getLuma(const cv::Mat& frame) {
+    return cv::Mat(getHeight(frame.rows), frame.cols, CV_8UC1, frame.data, frame.step);
+  }
+
+  /*
+   * Writes into the allocated CV_8UC3 matrix yuv the Y, U and V values of
+   * each pixel of the frame, without any conversion.
+   */
+  static void interleave(const cv::Mat& frame, cv::Mat& yuv, ThreadPool* pool = NULL);
+
+  /*
+   * Converts the CV_8UC3 matrix yuv into the BGR matrix bgr, which may be the
+   * same one, with the fixed-point BT.601 coefficients of
+   * cv::cvtColor(CV_YUV2BGR_I420).
+   */
+  static void toBGR(const cv::Mat& yuv, cv::Mat& bgr, ThreadPool* pool = NULL);
+
+  /*
+   * Same as toBGR() over the given number of interleaved pixels, the bgr
+   * buffer possibly being the yuv one.
+   */
+  static void toBGR(const uint8_t* yuv, uint8_t* bgr, size_t pixels);
+};
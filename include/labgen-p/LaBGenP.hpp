@@ -0,0 +1,349 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "Decimation.hpp"
+#include "DeviceMotion.hpp"
+#include "FrameDifferenceC1L1.hpp"
+#include "History.hpp"
+#include "I420.hpp"
+#include "MotionProba.hpp"
+#include "SummedAreaTables.hpp"
+#include "ThreadPool.hpp"
+#include "TiledPipeline.hpp"
+
+/* ========================================================================== *
+ * LaBGenP                                                                    *
+ * ========================================================================== */
+
+/*
+ * Stationary background generation from frames pushed one at a time, for
+ * one or several (S, N) pairs at once. There is one filter, one map of
+ * quantities of motion, and one history per value of N. A history of max(S)
+ * samples serves every S, since its first S samples are the ones a history of
+ * S samples would hold. All the buffers are allocated at construction for a
+ * given frame size, and the engine can be reset to process another sequence
+ * of the same size. The maps and the positives are stored on the fewest bits
+ * holding their values, see getEncoding().
+ *
+ * The first frame pushed only initializes the frame difference.
+ */
+class LaBGenP {
+  public:
+
+    struct Parameters {
+      /* Values of S and N, sorted and made unique by the engine. */
+      std::vector<int32_t> sParams;
+      std::vector<int32_t> nParams;
+
+      /* Engine of the quantities of motion, see MotionProba::create(). */
+      std::string filter;
+
+      /* Number of patches along each dimension, 0 for pixel level. */
+      int32_t segments;
+
+      /* Number of threads, 0 for all the cores, ignored given a pool. */
+      int32_t threads;
+
+      /*
+       * Amount added to the quantities of motion of the stored samples after
+       * each frame, so that the background follows the changes of the scene.
+       * 0 disables the aging.
+       */
+      uint32_t aging;
+
+      /*
+       * Factor by which the frames are reduced to compute the quantities of
+       * motion, the kernels being reduced accordingly. Each pixel then takes
+       * the quantity of motion of its block, the histories keeping the colors
+       * of all the pixels. 1 computes them at full resolution.
+       */
+      int32_t downscale;
+
+      /*
+       * Where the quantities of motion are computed: "cpu", or "opencl" for
+       * a DeviceMotion when an OpenCL device is available, the processor
+       * being used otherwise.
+       */
+      std::string device;
+
+      /*
+       * Format of the frames pushed: "bgr" for CV_8UC3 frames, or "i420" for
+       * planar YUV frames, see I420. The Y plane of the latter feeds the frame
+       * difference as is, and the histories store the Y, U and V values of the
+       * samples, the medians only being converted into BGR.
+       */
+      std::string format;
+
+      /*
+       * Number of tiles of rows whose quantities of motion are computed and
+       * inserted into the histories in a single pass, see TiledPipeline, the
+       * tiles being the unit of parallel work. 0 goes through whole-frame
+       * maps, which are also used with patches, a downscale, or a device.
+       */
+      int32_t tiles;
+
+      /*
+       * Folder of the files backing the histories, so that the histories which
+       * do not fit in memory are paged out to the disk instead of the swap,
+       * see MappedScratch. Empty keeps them in memory.
+       */
+      std::string backing;
+
+      /*
+       * Number of frames of the sequence per frame pushed, the others being
+       * skipped by the caller. It is only recorded in the checkpoints, so that
+       * a checkpoint is not resumed with another stride.
+       */
+      int32_t stride;
+
+      /**************************************************************************/
+
+      Parameters(int32_t s = 19, int32_t n = 3) :
+      sParams(1, s), nParams(1, n), filter("sat"), segments(0), threads(1),
+      aging(0), downscale(1), device("cpu"), format("bgr"), tiles(0),
+      backing(), stride(1) {}
+    };
+
+    /*
+     * Wall-clock time spent in each stage since the construction or the last
+     * reset, in seconds: the frame difference (with the reduction of the
+     * frames), the filters (with the replication of their maps), the update
+     * of the histories (with their aging, and the filters of the tiles), and
+     * the medians of updateBackground(). The const getBackground() is not timed,
+     * so that it can be called concurrently: its callers time it if needed.
+     */
+    struct Timings {
+      double difference;
+      double filtering;
+      double insertion;
+      double median;
+
+      /**************************************************************************/
+
+      Timings() : difference(0), filtering(0), insertion(0), median(0) {}
+    };
+
+  private:
+
+    Parameters params;
+    int32_t height;
+    int32_t width;
+
+    /* Size of the frames the quantities of motion are computed from. */
+    int32_t motionHeight;
+    int32_t motionWidth;
+
+    std::unique_ptr<ThreadPool> ownPool;
+    ThreadPool* pool;
+
+    FrameDifferenceC1L1 fdiff;
+    std::vector<std::shared_ptr<MotionProba> > filters;
+    std::vector<cv::Mat> quantitiesMotion;
+
+    /* The reduced frame and quantities of motion, with a downscale. */
+    Decimation decimation;
+    cv::Mat decimated;
+    std::vector<cv::Mat> reducedQuantitiesMotion;
+
+    /* The colors of the I420 frames, and their medians, as Y, U and V. */
+    cv::Mat yuvFrame;
+    cv::Mat yuvBackground;
+    std::vector<std::shared_ptr<BasePatchesHistory> > histories;
+
+    /*
+     * The motion scores are computed once for all the filters, either as a map
+     * or directly as its summed area table.
+     */
+    bool usesSums;
+    cv::Mat motionScores;
+    SummedAreaTables<MotionProba::ProbaMapEncoding> sums;
+
+    /* Replaces the frame difference and the filters when used. */
+    std::unique_ptr<DeviceMotion> device;
+
+    /* Replaces the filters and the whole-frame insertion when used. */
+    std::unique_ptr<TiledPipeline> tiled;
+
+    size_t numFrames;
+
+    Timings timings;
+
+  public:
+
+    /*
+     * Engine for height x width frames, of the format of the parameters.
+     * Given a pool, the engine uses it instead of creating its own.
+     */
+    LaBGenP(
+      int32_t height,
+      int32_t width,
+      const Parameters& params = Parameters(),
+      ThreadPool* pool = NULL
+    );
+
+    LaBGenP(const LaBGenP&) = delete;
+
+    LaBGenP& operator=(const LaBGenP&) = delete;
+
+    /*
+     * Processes a CV_8UC3 frame, or an I420 one, and returns the number of
+     * pixels whose history has been modified, summed over the values of N.
+     */
+    size_t pushFrame(const cv::Mat& frame);
+
+    /*
+     * Processes a frame whose quantities of motion have been computed
+     * beforehand, for instance read from a MotionCache: one continuous map per
+     * value of N, of the size and type of getReducedQuantitiesOfMotion(). Only
+     * the luma of the frame is computed, for the frames which follow. The
+     * quantities of motion of a first frame are ignored. The frame difference
+     * must not be computed on a device.
+     */
+    size_t pushFrame(const cv::Mat& frame, const std::vector<cv::Mat>& quantities);
+
+    /* Background of the smallest S and N. */
+    void getBackground(cv::Mat& background) const;
+
+    /* Background of a (S, N) pair among the parameters. */
+    void getBackground(cv::Mat& background, int32_t s, int32_t n) const;
+
+    /*
+     * Updates the background of the smallest S and N, only recomputing the
+     * pixels modified since the previous update, the other pixels of the
+     * background being kept as is. With I420 frames, only the pixels
+     * recomputed are converted into BGR, unless background is reallocated.
+     */
+    void updateBackground(cv::Mat& background);
+
+    /*
+     * Last quantities of motion computed for the smallest N, or replicated
+     * from the given ones with a downscale.
+     */
+    const cv::Mat& getQuantitiesOfMotion() const { return quantitiesMotion.front(); }
+
+    /*
+     * Last quantities of motion computed for each value of N, at the reduced
+     * size of the downscale.
+     */
+    const std::vector<cv::Mat>& getReducedQuantitiesOfMotion() const {
+      return reducedQuantitiesMotion;
+    }
+
+    /* Empties the histories, the next frame being a first frame. */
+    void reset();
+
+    /*
+     * Writes the state of the engine into a binary checkpoint, in the byte
+     * order of the host: the number of frames pushed, the stride, the luma of
+     * the last frame, and the histories. The checkpoint is written next to path, then
+     * renamed, so that path always holds a complete checkpoint.
+     */
+    void save(const std::string& path) const;
+
+    /*
+     * Restores a checkpoint written by an engine having the same frame size,
+     * values of N, largest S, segments, and stride. The file is mapped in
+     * memory and copied into the buffers of the engine, the next frame being
+     * compared to the last frame of the checkpoint. A runtime_error is thrown
+     * if the checkpoint does not match the engine or is corrupt, the state of
+     * the engine being left unchanged.
+     */
+    void load(const std::string& path);
+
+    /* Size of the frames of a checkpoint. */
+    static cv::Size getCheckpointSize(const std::string& path);
+
+    /*
+     * Merges the state of an engine having the same frame size and parameters,
+     * that has processed the part of the sequence following the one processed by
+     * this engine, the first frame of that part being the last frame of this
+     * one. The histories are then those of the whole sequence, and the next
+     * frame is compared to the last frame of newer. Returns the number of
+     * pixels whose history has been modified, summed over the values of N.
+     * Without aging only: the samples of this engine are not aged by the frames
+     * of newer.
+     */
+    size_t merge(const LaBGenP& newer);
+
+    const Parameters& getParameters() const { return params; }
+
+    int32_t getHeight() const { return height; }
+
+    int32_t getWidth() const { return width; }
+
+    /* Whether the quantities of motion are computed on an OpenCL device. */
+    bool usesDevice() const { return device.get() != NULL; }
+
+    /* Whether the frames are processed in tiles. */
+    bool usesTiles() const { return tiled.get() != NULL; }
+
+    /* Workers used by the engine, either given or owned. */
+    ThreadPool* getPool() const { return pool; }
+
+    /* Number of frames pushed since the construction or the last reset. */
+    size_t getNumFrames() const { return numFrames; }
+
+    const Timings& getTimings() const { return timings; }
+
+    /* Memory allocated by the histories, in bytes. */
+    size_t getHistoriesMemory() const;
+
+    /* Estimation of the memory allocated by an engine, in bytes. */
+    static size_t getMemory(const Parameters& params, int32_t height, int32_t width);
+
+  protected:
+
+    /* Given quantities of motion are used instead of being computed. */
+    size_t process(const cv::Mat& frame, const std::vector<cv::Mat>* quantities);
+
+    static Parameters normalize(const Parameters& params);
+
+    /*
+     * Encoding of the quantities of motion of a value of N, which is also the
+     * one of the positives of its history: the narrowest one holding all of
+     * them, but 32 bits with aging.
+     */
+    static int getEncoding(
+      const Parameters& params,
+      int32_t height,
+      int32_t width,
+      int32_t n
+    );
+
+    void prepareBackground(cv::Mat& background) const;
+
+    /*
+     * Previous luma of the frame difference, either on the processor or on
+     * the device.
+     */
+    bool isPrimed() const;
+
+    void getLuma(cv::Mat& luma) const;
+
+    void prime(const cv::Mat& luma);
+};
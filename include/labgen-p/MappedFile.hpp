@@ -0,0 +1,83 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/* ========================================================================== *
+ * MappedFile                                                                 *
+ * ========================================================================== */
+
+/*
+ * Read-only mapping of a whole file in memory, so that its content is only
+ * read from the disk when it is accessed.
+ */
+class MappedFile {
+  private:
+
+    const uint8_t* data;
+    size_t length;
+
+  public:
+
+    explicit MappedFile(const std::string& path);
+
+    MappedFile(const MappedFile&) = delete;
+
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile();
+
+    const uint8_t* getData() const { return data; }
+
+    size_t getSize() const { return length; }
+};
+
+/* ========================================================================== *
+ * MappedScratch                                                              *
+ * ========================================================================== */
+
+/*
+ * Writable mapping of a new file of a given size, filled with zeros, created
+ * in a folder. The file is removed as soon as it is mapped: it disappears with
+ * the mapping, and meanwhile the system writes the pages which are not
+ * accessed back to it instead of to the swap.
+ */
+class MappedScratch {
+  private:
+
+    uint8_t* data;
+    size_t length;
+
+  public:
+
+    MappedScratch(const std::string& folder, size_t length);
+
+    MappedScratch(const MappedScratch&) = delete;
+
+    MappedScratch& operator=(const MappedScratch&) = delete;
+
+    ~MappedScratch();
+
+    uint8_t* getData() const { return data; }
+
+    size_t getSize() const { return length; }
+};
@@ -0,0 +1,372 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LABGEN_P_SSE2
+#endif
+
+/* ========================================================================== *
+ * MedianNetwork                                                              *
+ * ========================================================================== */
+
+/*
+ * Medians of small sets of bytes without any allocation. The medians of
+ * LANES sets having the same size are computed at once by running Batcher's
+ * merge-exchange sorting network (D. Knuth, TAOCP vol. 3, algorithm 5.2.2M)
+ * on SIMD registers, each lane holding one set. For an even size, the median
+ * is the truncated average of the two middle values.
+ */
+struct MedianNetwork {
+  static const size_t LANES = 16;
+
+  /* Largest set size handled by the network, larger sets use histograms. */
+  static const size_t MAX_SIZE = 32;
+
+  /****************************************************************************/
+
+#ifdef LABGEN_P_SSE2
+  typedef __m128i                                                       Vector;
+
+  static Vector load(const uint8_t* data) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+  }
+
+  static void store(uint8_t* data, Vector v) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(data), v);
+  }
+
+  static void compareExchange(Vector& a, Vector& b) {
+    Vector lo = _mm_min_epu8(a, b);
+    b = _mm_max_epu8(a, b);
+    a = lo;
+  }
+
+  static Vector average(Vector a, Vector b) {
+    return _mm_sub_epi8(
+      _mm_avg_epu8(a, b),
+      _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1))
+    );
+  }
+#else
+  struct Vector {
+    uint8_t v[LANES];
+  };
+
+  static Vector load(const uint8_t* data) {
+    Vector v;
+    std::memcpy(v.v, data, LANES);
+
+    return v;
+  }
+
+  static void store(uint8_t* data, const Vector& v) {
+    std::memcpy(data, v.v, LANES);
+  }
+
+  static void compareExchange(Vector& a, Vector& b) {
+    for (size_t l = 0; l < LANES; ++l) {
+      uint8_t lo = std::min(a.v[l], b.v[l]);
+      b.v[l] = std::max(a.v[l], b.v[l]);
+      a.v[l] = lo;
+    }
+  }
+
+  static Vector average(const Vector& a, const Vector& b) {
+    Vector v;
+
+    for (size_t l = 0; l < LANES; ++l)
+      v.v[l] = (static_cast<int>(a.v[l]) + b.v[l]) / 2;
+
+    return v;
+  }
+#endif
+
+  /****************************************************************************/
+
+  /*
+   * Comparators of the networks selecting the median of 2 to MAX_SIZE
+   * elements, generated once and stored consecutively: the network for n
+   * elements is made of the comparators [offsets[n], offsets[n + 1]). Each one
+   * is the sorting network of Batcher, pruned from the comparators that have
+   * no influence on the middle element(s).
+   */
+  struct Comparators {
+    static const size_t CAPACITY = (MAX_SIZE + 1) * 256;
+
+    uint8_t lo[CAPACITY];
+    uint8_t hi[CAPACITY];
+    size_t offsets[MAX_SIZE + 2];
+
+    Comparators() {
+      size_t num = 0;
+
+      offsets[0] = offsets[1] = offsets[2] = 0;
+
+      for (size_t n = 2; n <= MAX_SIZE; ++n) {
+        uint8_t sortLo[256];
+        uint8_t sortHi[256];
+        size_t sortNum = 0;
+
+        size_t t = 0;
+
+        while ((static_cast<size_t>(1) << t) < n)
+          ++t;
+
+        for (size_t p = static_cast<size_t>(1) << (t - 1); p > 0; p >>= 1) {
+          size_t q = static_cast<size_t>(1) << (t - 1);
+          size_t r = 0;
+          size_t d = p;
+
+          for (;;) {
+            for (size_t i = 0; i < n - d; ++i) {
+              if ((i & p) == r) {
+                sortLo[sortNum] = static_cast<uint8_t>(i);
+                sortHi[sortNum] = static_cast<uint8_t>(i + d);
+                ++sortNum;
+              }
+            }
+
+            if (q == p)
+              break;
+
+            d = q - p;
+            q >>= 1;
+            r = p;
+          }
+        }
+
+        /* Backward pruning from the middle element(s). */
+        bool needed[MAX_SIZE] = { false };
+        bool kept[256] = { false };
+
+        needed[n / 2] = true;
+        needed[(n - 1) / 2] = true;
+
+        for (size_t i = sortNum; i-- > 0;) {
+          if (needed[sortLo[i]] || needed[sortHi[i]]) {
+            needed[sortLo[i]] = needed[sortHi[i]] = true;
+            kept[i] = true;
+          }
+        }
+
+        for (size_t i = 0; i < sortNum; ++i) {
+          if (kept[i]) {
+            lo[num] = sortLo[i];
+            hi[num] = sortHi[i];
+            ++num;
+          }
+        }
+
+        offsets[n + 1] = num;
+      }
+    }
+  };
+
+  /****************************************************************************/
+
+  static const Comparators& getComparators() {
+    static const Comparators comparators;
+    return comparators;
+  }
+
+  /****************************************************************************/
+
+  /*
+   * Reorders the n first elements of values, n <= MAX_SIZE, so that the
+   * middle one(s) are the ones of the sorted sequence.
+   */
+  template <typename T>
+  static void select(T* values, size_t n) {
+    if (n < 2)
+      return;
+
+    const Comparators& comparators = getComparators();
+
+    for (size_t i = comparators.offsets[n], end = comparators.offsets[n + 1]; i < end; ++i)
+      exchange(values[comparators.lo[i]], values[comparators.hi[i]]);
+  }
+
+  /****************************************************************************/
+
+  /*
+   * Transposes the LANES x size bytes at data (rows separated by stride) into
+   * size vectors, the vector k holding the byte k of every row. Up to
+   * LANES - 1 bytes may be read after the last byte of the last row.
+   */
+  static void transpose(
+    const uint8_t* data,
+    size_t stride,
+    size_t size,
+    Vector* columns
+  ) {
+#ifdef LABGEN_P_SSE2
+    for (size_t chunk = 0; chunk < size; chunk += LANES) {
+      __m128i x[LANES];
+      __m128i y[LANES];
+
+      for (size_t r = 0; r < LANES; ++r)
+        x[r] = load(data + r * stride + chunk);
+
+      /* Pairs of rows, then quadruples, octuples, and finally all the rows. */
+      for (size_t i = 0; i < 8; ++i) {
+        y[i]     = _mm_unpacklo_epi8(x[2 * i], x[2 * i + 1]);
+        y[i + 8] = _mm_unpackhi_epi8(x[2 * i], x[2 * i + 1]);
+      }
+
+      for (size_t h = 0; h < 2; ++h) {
+        for (size_t m = 0; m < 4; ++m) {
+          x[h * 8 + m]     = _mm_unpacklo_epi16(y[h * 8 + 2 * m], y[h * 8 + 2 * m + 1]);
+          x[h * 8 + m + 4] = _mm_unpackhi_epi16(y[h * 8 + 2 * m], y[h * 8 + 2 * m + 1]);
+        }
+      }
+
+      for (size_t g = 0; g < 4; ++g) {
+        for (size_t h = 0; h < 2; ++h) {
+          y[4 * g + h]     = _mm_unpacklo_epi32(x[4 * g + 2 * h], x[4 * g + 2 * h + 1]);
+          y[4 * g + 2 + h] = _mm_unpackhi_epi32(x[4 * g + 2 * h], x[4 * g + 2 * h + 1]);
+        }
+      }
+
+      size_t columnsInChunk = std::min(LANES, size - chunk);
+
+      for (size_t c = 0; c < columnsInChunk; ++c) {
+        size_t pair = c / 2;
+
+        columns[chunk + c] = (c & 1) ?
+          _mm_unpackhi_epi64(y[2 * pair], y[2 * pair + 1]) :
+          _mm_unpacklo_epi64(y[2 * pair], y[2 * pair + 1]);
+      }
+    }
+#else
+    for (size_t r = 0; r < LANES; ++r) {
+      for (size_t c = 0; c < size; ++c)
+        columns[c].v[r] = data[r * stride + c];
+    }
+#endif
+  }
+
+  /****************************************************************************/
+
+  /*
+   * Medians of LANES pixels having n samples each, with 0 < n <= MAX_SIZE.
+   * The component c of the sample k of the pixel p is read at
+   * data[p * pixelStride + c * channelStride + k], with
+   * channelStride <= MAX_SIZE, and the median of the pixel p is written at
+   * result[p * channels + c]. Up to LANES - 1 bytes may be read after the
+   * last sample of the last pixel.
+   */
+  static void median(
+    const uint8_t* data,
+    size_t pixelStride,
+    size_t channelStride,
+    size_t channels,
+    size_t n,
+    uint8_t* result
+  ) {
+    Vector columns[MAX_SIZE * 4];
+    uint8_t medians[LANES];
+
+    transpose(data, pixelStride, (channels - 1) * channelStride + n, columns);
+
+    for (size_t c = 0; c < channels; ++c) {
+      Vector* values = columns + c * channelStride;
+
+      select(values, n);
+
+      size_t middle = n / 2;
+
+      if (n & 1)
+        store(medians, values[middle]);
+      else
+        store(medians, average(values[middle - 1], values[middle]));
+
+      for (size_t p = 0; p < LANES; ++p)
+        result[p * channels + c] = medians[p];
+    }
+  }
+
+  /****************************************************************************/
+
+  /*
+   * Median of a single set of n > 0 bytes.
+   */
+  static uint8_t median(const uint8_t* data, size_t n) {
+    size_t middle = n / 2;
+
+    if (n <= MAX_SIZE) {
+      uint8_t values[MAX_SIZE];
+      std::copy(data, data + n, values);
+
+      select(values, n);
+
+      if (n & 1)
+        return values[middle];
+
+      return (static_cast<int>(values[middle - 1]) + values[middle]) / 2;
+    }
+
+    /* Larger sets: the two middle values are read from a histogram. */
+    uint32_t histogram[256];
+    std::fill(histogram, histogram + 256, 0);
+
+    for (size_t k = 0; k < n; ++k)
+      ++histogram[data[k]];
+
+    int lower = -1;
+    size_t cumulated = 0;
+
+    for (int v = 0; v < 256; ++v) {
+      cumulated += histogram[v];
+
+      if (lower < 0 && cumulated >= middle)
+        lower = v;
+
+      if (cumulated > middle) {
+        if (n & 1)
+          return v;
+
+        return (lower + v) / 2;
+      }
+    }
+
+    return 255;
+  }
+
+  /****************************************************************************/
+
+  template <typename T>
+  static void exchange(T& a, T& b) {
+    T lo = std::min(a, b);
+    b = std::max(a, b);
+    a = lo;
+  }
+
+  /****************************************************************************/
+
+  static void exchange(Vector& a, Vector& b) {
+    compareExchange(a, b);
+  }
+};
@@ -0,0 +1,162 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "MappedFile.hpp"
+
+/* State of the streams of zlib. */
+struct z_stream_s;
+
+/* ========================================================================== *
+ * MotionCache                                                                *
+ * ========================================================================== */
+
+/*
+ * Quantities of motion of the frames of a sequence for a value of N, stored
+ * in a file by a MotionCacheWriter, so that later runs, for instance with
+ * other values of S, read them instead of computing them. The file holds a
+ * key identifying the sequence and its processing, the size and the type of
+ * the maps, their number and compression level, then the maps themselves in
+ * the byte order of the host. The maps are stored on the fewest bits holding
+ * their values and at the reduced size of a downscale, but without any loss,
+ * since the samples selected by the histories depend on the exact quantities
+ * of motion.
+ *
+ * The file is mapped in memory. Uncompressed maps are matrix headers on the
+ * mapping: nothing is read from the disk before it is accessed, nor copied.
+ * Compressed maps are the differences between the neighbouring values of the
+ * rows, which are small since the maps are box filtered, compressed by zlib.
+ * They are decoded into buffers of the cache reused from frame to frame.
+ */
+class MotionCache {
+  private:
+
+    MappedFile file;
+    std::string key;
+    int rows;
+    int cols;
+    int type;
+    size_t frames;
+    int level;
+    const uint8_t* maps;
+
+    /* Offsets of the compressed maps in the file, and of its end. */
+    std::vector<size_t> offsets;
+    std::unique_ptr<z_stream_s> inflater;
+    std::vector<uint8_t> residuals;
+    cv::Mat decoded;
+
+  public:
+
+    explicit MotionCache(const std::string& path);
+
+    MotionCache(const MotionCache&) = delete;
+
+    MotionCache& operator=(const MotionCache&) = delete;
+
+    ~MotionCache();
+
+    const std::string& getKey() const { return key; }
+
+    cv::Size getSize() const { return cv::Size(cols, rows); }
+
+    int getType() const { return type; }
+
+    size_t getFrames() const { return frames; }
+
+    /* Compression level of zlib, 0 for uncompressed maps. */
+    int getLevel() const { return level; }
+
+    /*
+     * Map of the frame num, which must not be modified, either on the mapping
+     * or decoded into a buffer that is only valid until the next call.
+     */
+    cv::Mat getQuantities(size_t num);
+
+    /* Path of the cache of a key in a folder, named after a hash of the key. */
+    static std::string getPath(const std::string& folder, const std::string& key);
+
+    /* FNV-1a hash of some data, on 64 bits. */
+    static uint64_t getHash(const std::string& data);
+};
+
+/* ========================================================================== *
+ * MotionCacheWriter                                                          *
+ * ========================================================================== */
+
+/*
+ * Writes the maps of a MotionCache one frame at a time, compressed with the
+ * given level of zlib from 1 to 9, or uncompressed with 0. The run-length
+ * strategy of zlib suits the planes of differences, and is much faster than
+ * its default one for the same size. The cache is written next to its path,
+ * then renamed once closed, so that an interrupted run leaves no incomplete
+ * cache behind.
+ */
+class MotionCacheWriter {
+  private:
+
+    std::string path;
+    std::string temporary;
+    std::ofstream stream;
+    int rows;
+    int cols;
+    int type;
+    size_t frames;
+    int level;
+    std::streamoff framesOffset;
+
+    /* Differences of the values of a map, and their compression. */
+    std::unique_ptr<z_stream_s> deflater;
+    std::vector<uint8_t> residuals;
+    std::vector<uint8_t> compressed;
+
+  public:
+
+    MotionCacheWriter(
+      const std::string& path,
+      const std::string& key,
+      const cv::Size& size,
+      int type,
+      int level = 1
+    );
+
+    MotionCacheWriter(const MotionCacheWriter&) = delete;
+
+    MotionCacheWriter& operator=(const MotionCacheWriter&) = delete;
+
+    /* Removes the cache written so far unless it has been closed. */
+    ~MotionCacheWriter();
+
+    /* Appends the map of the next frame. */
+    void write(const cv::Mat& quantities);
+
+    /* Completes the cache, renamed to its path. */
+    void close();
+
+    size_t getFrames() const { return frames; }
+};
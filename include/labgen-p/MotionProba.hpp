@@ -19,21 +19,34 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
+#include <memory>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
 #include "SummedAreaTables.hpp"
+#include "ThreadPool.hpp"
 
 /* ========================================================================== *
- * CounterMotionProba                                                         *
+ * MotionProba                                                                *
  * ========================================================================== */
 
 /*
- * Efficient version using using F. Crown summed area tables.
+ * Computes the quantities of motion by summing the motion scores over a square
+ * kernel of a given size centered on each pixel, the kernel being cropped to
+ * the image. Given a thread pool, the engines process bands of rows
+ * concurrently.
+ *
+ * The motion scores are CV_8UC1 or CV_32SC1 matrices, and the quantities of
+ * motion are written as CV_16UC1 or CV_32SC1 matrices, depending on the type
+ * of the output matrix. getOpenCVEncoding() gives the narrowest one holding
+ * all the quantities of motion of the kernel.
  */
-class CounterMotionProba {
+class MotionProba {
   public:
 
     typedef int32_t                                           ProbaMapEncoding;
@@ -41,36 +54,344 @@ class CounterMotionProba {
   protected:
 
     int size;
+    ThreadPool* pool;
 
   public:
 
-    CounterMotionProba(int size) : size(size) {}
+    MotionProba(int size, ThreadPool* pool = NULL) : size(size), pool(pool) {}
+
+    virtual ~MotionProba() {}
+
+    /*
+     * Instantiates the engine named "sat" (CounterMotionProba) or "separable"
+     * (SeparableCounterMotionProba).
+     */
+    static std::shared_ptr<MotionProba> create(
+      const std::string& engine,
+      int size,
+      ThreadPool* pool = NULL
+    );
+
+    virtual void compute(const cv::Mat& inputProbaMap, cv::Mat& outputProbaMap) = 0;
+
+    /*
+     * Whether the engine can take the summed area table of the motion scores
+     * instead of the scores themselves. The table can then be filled by the
+     * caller, for instance by FrameDifferenceC1L1, and shared by several
+     * engines: computeFromSums() gives the same result as compute() on the
+     * scores.
+     */
+    virtual bool usesSums() const {
+      return false;
+    }
 
-    void compute(cv::Mat& inputProbaMap, cv::Mat& outputProbaMap) const {
+    virtual void computeFromSums(
+      const SummedAreaTables<ProbaMapEncoding>& /* sums */,
+      cv::Mat& /* outputProbaMap */
+    ) {
+      throw std::logic_error("This engine does not use summed area tables!");
+    }
+
+    /*
+     * CV_16UC1 if the largest quantity of motion, a kernel full of the largest
+     * score, is below the largest 16-bit value, which marks the unused samples
+     * of the histories, and CV_32SC1 otherwise.
+     */
+    int getOpenCVEncoding() const {
+      int64_t largest = static_cast<int64_t>(size) * size * 255;
+      return (largest < 0xFFFF) ? CV_16UC1 : CV_32SC1;
+    }
+
+  protected:
+
+    int getHalf() const {
       int half = size / 2;
 
       if (half == 0)
         throw std::runtime_error("Size divided by 2 is zero!");
 
-      ProbaMapEncoding* outputBuffer =
-        reinterpret_cast<ProbaMapEncoding*>(outputProbaMap.data);
+      return half;
+    }
+};
+
+/* ========================================================================== *
+ * CounterMotionProba                                                         *
+ * ========================================================================== */
+
+/*
+ * Efficient version using using F. Crown summed area tables. The table is kept
+ * between two calls to compute() so that it is allocated only once. The box
+ * sums are read without any bounds check: the rows of the kernel are clamped
+ * once per output row, and the columns are clamped only in the left and right
+ * borders. The table can also be filled by the caller, see usesSums().
+ */
+class CounterMotionProba : public MotionProba {
+  protected:
+
+    SummedAreaTables<ProbaMapEncoding> sums;
 
-      SummedAreaTables<ProbaMapEncoding> sums(inputProbaMap);
+  public:
+
+    CounterMotionProba(int size, ThreadPool* pool = NULL) :
+      MotionProba(size, pool), sums() {}
+
+    virtual void compute(const cv::Mat& inputProbaMap, cv::Mat& outputProbaMap) {
+      if (pool == NULL)
+        sums.compute(inputProbaMap);
+      else {
+        /* The running sums of the rows, then their accumulation by columns. */
+        sums.allocate(inputProbaMap.rows, inputProbaMap.cols);
+
+        pool->parallelFor(0, inputProbaMap.rows, [&](size_t begin, size_t end) {
+          sums.computeRows(inputProbaMap, begin, end);
+        });
+
+        pool->parallelFor(0, inputProbaMap.cols, [&](size_t begin, size_t end) {
+          sums.accumulateRows(begin, end);
+        });
+      }
+
+      computeFromSums(sums, outputProbaMap);
+    }
+
+    virtual bool usesSums() const {
+      return true;
+    }
+
+    virtual void computeFromSums(
+      const SummedAreaTables<ProbaMapEncoding>& sums,
+      cv::Mat& outputProbaMap
+    ) {
+      int half = getHalf();
+      int rows = sums.getHeight();
+      int depth = outputProbaMap.depth();
+
+      if (depth != CV_16U && depth != CV_32S)
+        throw std::logic_error("Unsupported encoding of the quantities of motion");
+
+      ThreadPool::run(pool, 0, rows, [&](size_t begin, size_t end) {
+        if (depth == CV_16U)
+          computeFromSums<uint16_t>(sums, outputProbaMap, half, begin, end);
+        else
+          computeFromSums<int32_t>(sums, outputProbaMap, half, begin, end);
+      });
+    }
+
+  protected:
+
+    template <typename Out>
+    static void computeFromSums(
+      const SummedAreaTables<ProbaMapEncoding>& sums,
+      cv::Mat& outputProbaMap,
+      int half,
+      int minRow,
+      int maxRow
+    ) {
+      int rows = sums.getHeight();
+      int cols = sums.getWidth();
+
+      /* Columns [xBegin, xEnd) have their whole kernel inside the image. */
+      int xBegin = std::min(half, cols);
+      int xEnd = std::max(cols - half, xBegin);
+
+      for (int y = minRow; y < maxRow; ++y) {
+        Out* outputBuffer = outputProbaMap.ptr<Out>(y);
+
+        /* Computing kernel ROI. */
+        const ProbaMapEncoding* top = sums.getPaddedRow(std::max(y - half, 0));
+        const ProbaMapEncoding* bottom =
+          sums.getPaddedRow(std::min(y + half, rows - 1) + 1);
+
+        for (int x = 0; x < xBegin; ++x) {
+          int minCol = 0;
+          int maxCol = std::min(x + half, cols - 1) + 1;
+
+          outputBuffer[x] = static_cast<Out>(
+            bottom[maxCol] - top[maxCol] - bottom[minCol] + top[minCol]
+          );
+        }
+
+        for (int x = xBegin; x < xEnd; ++x) {
+          outputBuffer[x] = static_cast<Out>(
+            bottom[x + half + 1] - top[x + half + 1] -
+            bottom[x - half]     + top[x - half]
+          );
+        }
 
-      for (int y = 0; y < inputProbaMap.rows; ++y) {
-        for (int x = 0; x < inputProbaMap.cols; ++x, ++outputBuffer) {
-          /* Computing kernel ROI. */
-          int xROI = std::max(x - half, 0);
-          int yROI = std::max(y - half, 0);
-          int widthROI = std::min(x + half, (inputProbaMap.cols - 1)) - std::max(x - half, 0) + 1;
-          int heightROI = std::min(y + half, (inputProbaMap.rows - 1)) - std::max(y - half, 0) + 1;
+        for (int x = xEnd; x < cols; ++x) {
+          int minCol = std::max(x - half, 0);
+          int maxCol = cols;
 
-          *outputBuffer = sums.getIntegral(yROI, yROI + heightROI - 1, xROI, xROI + widthROI - 1);
+          outputBuffer[x] = static_cast<Out>(
+            bottom[maxCol] - top[maxCol] - bottom[minCol] + top[minCol]
+          );
         }
       }
     }
+};
 
-    int getOpenCVEncoding() const {
-      return CV_32SC1;
+/* ========================================================================== *
+ * SeparableCounterMotionProba                                                *
+ * ========================================================================== */
+
+/*
+ * Same quantities of motion as CounterMotionProba, computed with two running
+ * sums. The vertical one keeps, for every column, the sum of the scores of the
+ * rows covered by the kernel: moving to the next row adds the row entering the
+ * kernel and removes the one leaving it, a loop over the columns that is
+ * vectorized. The horizontal one slides along this row of column sums. Both
+ * are cropped to the image exactly like the summed area tables, so that the
+ * results are identical. With a thread pool, each thread processes a single
+ * band of rows, since the column sums of a band are first computed from
+ * scratch. The column sums of all the bands are kept from frame to frame.
+ */
+class SeparableCounterMotionProba : public MotionProba {
+  protected:
+
+    std::vector<ProbaMapEncoding> columnSums;
+
+  public:
+
+    SeparableCounterMotionProba(int size, ThreadPool* pool = NULL) :
+      MotionProba(size, pool), columnSums() {}
+
+    virtual void compute(const cv::Mat& inputProbaMap, cv::Mat& outputProbaMap) {
+      int inputDepth = inputProbaMap.depth();
+      int outputDepth = outputProbaMap.depth();
+
+      if (inputDepth == CV_8U && outputDepth == CV_16U)
+        compute<uint8_t, uint16_t>(inputProbaMap, outputProbaMap);
+      else if (inputDepth == CV_8U && outputDepth == CV_32S)
+        compute<uint8_t, int32_t>(inputProbaMap, outputProbaMap);
+      else if (inputDepth == CV_32S && outputDepth == CV_16U)
+        compute<int32_t, uint16_t>(inputProbaMap, outputProbaMap);
+      else if (inputDepth == CV_32S && outputDepth == CV_32S)
+        compute<int32_t, int32_t>(inputProbaMap, outputProbaMap);
+      else
+        throw std::logic_error("Unsupported encodings of the motion scores");
+    }
+
+  protected:
+
+    template <typename In, typename Out>
+    void compute(const cv::Mat& inputProbaMap, cv::Mat& outputProbaMap) {
+      int half = getHalf();
+      int rows = inputProbaMap.rows;
+      size_t cols = inputProbaMap.cols;
+
+      columnSums.resize(ThreadPool::getBands(pool, rows) * cols);
+
+      ThreadPool::runBands(pool, 0, rows, [&](size_t band, size_t begin, size_t end) {
+        compute<In, Out>(
+          inputProbaMap, outputProbaMap, half, begin, end,
+          columnSums.data() + band * cols
+        );
+      });
+    }
+
+    template <typename In, typename Out>
+    static void compute(
+      const cv::Mat& inputProbaMap,
+      cv::Mat& outputProbaMap,
+      int half,
+      int minRow,
+      int maxRow,
+      ProbaMapEncoding* sums
+    ) {
+      int rows = inputProbaMap.rows;
+      int cols = inputProbaMap.cols;
+
+      /* Rows of the kernel of minRow - 1, which are updated for minRow. */
+      std::fill(sums, sums + cols, 0);
+
+      for (int y = std::max(minRow - half - 1, 0); y < std::min(minRow + half, rows); ++y)
+        addRow(inputProbaMap.ptr<In>(y), sums, cols);
+
+      for (int y = minRow; y < maxRow; ++y) {
+        if (y + half < rows)
+          addRow(inputProbaMap.ptr<In>(y + half), sums, cols);
+
+        if (y - half - 1 >= 0)
+          subtractRow(inputProbaMap.ptr<In>(y - half - 1), sums, cols);
+
+        slide(sums, outputProbaMap.ptr<Out>(y), cols, half);
+      }
+    }
+
+    template <typename In>
+    static void addRow(
+      const In* row,
+      ProbaMapEncoding* sums,
+      int cols
+    ) {
+      for (int x = 0; x < cols; ++x)
+        sums[x] += row[x];
+    }
+
+    template <typename In>
+    static void subtractRow(
+      const In* row,
+      ProbaMapEncoding* sums,
+      int cols
+    ) {
+      for (int x = 0; x < cols; ++x)
+        sums[x] -= row[x];
+    }
+
+    template <typename Out>
+    static void slide(
+      const ProbaMapEncoding* sums,
+      Out* output,
+      int cols,
+      int half
+    ) {
+      ProbaMapEncoding sum = 0;
+
+      for (int x = 0; x < std::min(half, cols); ++x)
+        sum += sums[x];
+
+      /*
+       * Columns [xBegin, xEnd) add a column entering the kernel and remove one
+       * leaving it, both inside the image.
+       */
+      int xBegin = std::min(half + 1, cols);
+      int xEnd = std::max(cols - half, xBegin);
+
+      for (int x = 0; x < xBegin; ++x) {
+        if (x + half < cols)
+          sum += sums[x + half];
+
+        output[x] = static_cast<Out>(sum);
+      }
+
+      for (int x = xBegin; x < xEnd; ++x) {
+        sum += sums[x + half] - sums[x - half - 1];
+        output[x] = static_cast<Out>(sum);
+      }
+
+      for (int x = xEnd; x < cols; ++x) {
+        if (x - half - 1 >= 0)
+          sum -= sums[x - half - 1];
+
+        output[x] = static_cast<Out>(sum);
+      }
     }
 };
+
+/* ========================================================================== *
+ * MotionProba factory                                                        *
+ * ========================================================================== */
+
+inline std::shared_ptr<MotionProba> MotionProba::create(
+  const std::string& engine,
+  int size,
+  ThreadPool* pool
+) {
+  if (engine == "sat")
+    return std::make_shared<CounterMotionProba>(size, pool);
+
+  if (engine == "separable")
+    return std::make_shared<SeparableCounterMotionProba>(size, pool);
+
+  throw std::runtime_error("Unknown motion filter engine '" + engine + "'!");
+}
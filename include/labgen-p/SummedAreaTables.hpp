@@ -20,7 +20,9 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
 #include <stdexcept>
+#include <vector>
 
 #include <opencv2/core/core.hpp>
 
@@ -31,6 +33,14 @@
 /**
  * This class implements the method known as "Integral Image Representation"
  * or "Summed area tables" introduced by F. Crown at SIGGRAPH 1984.
+ *
+ * The table is stored with an additional first row and column of zeros, so
+ * that getUncheckedIntegral() can be used for any row and column in
+ * [-1, h - 1] and [-1, w - 1] without any test. A table can be recomputed in
+ * place for a new matrix, the storage being reallocated only if the size of
+ * the matrix changes. It can also be filled row by row by the caller, after
+ * allocate(), through the mutable getPaddedRow(). The matrix either has the
+ * type of the table, or is made of 8-bit values.
  */
 template <typename T>
 class SummedAreaTables {
@@ -38,17 +48,52 @@ class SummedAreaTables {
 
     int w;
     int h;
-    T* sum;
+    std::vector<T> sum;
 
   public :
 
+    SummedAreaTables();
+
     SummedAreaTables(const cv::Mat& mat);
 
     virtual ~SummedAreaTables();
 
+    void compute(const cv::Mat& mat);
+
+    /* Prepares the table for a matrix of the given size. */
+    void allocate(int height, int width);
+
+    /*
+     * Two passes building the table like compute() that can be run
+     * concurrently on bands: the running sums of the rows [minRow, maxRow) of
+     * the matrix, then their accumulation down the columns [minCol, maxCol).
+     */
+    void computeRows(const cv::Mat& mat, int minRow, int maxRow);
+
+    void accumulateRows(int minCol, int maxCol);
+
+    int getWidth() const { return w; }
+
+    int getHeight() const { return h; }
+
+    /* Row of the table holding the sums up to the matrix row (row - 1). */
+    const T* getPaddedRow(int row) const { return sum.data() + row * (w + 1); }
+
+    T* getPaddedRow(int row) { return sum.data() + row * (w + 1); }
+
+    T getUncheckedIntegral(int row, int col) const;
+
     T getIntegral(int row, int col) const;
 
     T getIntegral(int min_row, int max_row, int min_col, int max_col) const;
+
+  protected :
+
+    template <typename U>
+    void computeFrom(const cv::Mat& mat);
+
+    template <typename U>
+    void computeRowsFrom(const cv::Mat& mat, int minRow, int maxRow);
 };
 
 #define _SUMMED_AREA_TABLES_TPP_
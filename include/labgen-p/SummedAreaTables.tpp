@@ -25,32 +25,127 @@
  * SummedAreaTables                                                           *
  * ========================================================================== */
 
+template <typename T>
+SummedAreaTables<T>::SummedAreaTables() :
+w(0),
+h(0),
+sum() {}
+
+/******************************************************************************/
+
 template <typename T>
 SummedAreaTables<T>::SummedAreaTables(const cv::Mat& mat) :
-w(mat.cols),
-h(mat.rows),
-sum(new T[mat.cols * mat.rows]) {
-  if (w == 0) throw std::logic_error("Image with width == 0 are not supported");
-  if (h == 0) throw std::logic_error("Image with height == 0 are not supported");
+w(0),
+h(0),
+sum() {
+  compute(mat);
+}
+
+/******************************************************************************/
+
+template <typename T>
+SummedAreaTables<T>::~SummedAreaTables() {}
+
+/******************************************************************************/
+
+template <typename T>
+void SummedAreaTables<T>::compute(const cv::Mat& mat) {
+  if (mat.depth() == CV_8U)
+    computeFrom<uint8_t>(mat);
+  else
+    computeFrom<T>(mat);
+}
 
-  const T* buffer = reinterpret_cast<const T*>(mat.data);
+/******************************************************************************/
+
+/*
+ * Each row of the table is the row above it plus the running sum of the
+ * corresponding row of the matrix.
+ */
+template <typename T>
+template <typename U>
+void SummedAreaTables<T>::computeFrom(const cv::Mat& mat) {
+  allocate(mat.rows, mat.cols);
 
   for (int row = 0; row < h; ++row) {
+    const U* buffer = mat.ptr<U>(row);
+    const T* above = sum.data() + row * (w + 1) + 1;
+          T* current = sum.data() + (row + 1) * (w + 1) + 1;
+
+    T rowSum = T();
+
     for (int col = 0; col < w; ++col) {
-      sum [ row * w + col ] =
-        *(buffer++)                   +
-        getIntegral(row - 1, col    ) +
-        getIntegral(row    , col - 1) -
-        getIntegral(row - 1, col - 1) ;
+      rowSum += buffer[col];
+      current[col] = above[col] + rowSum;
     }
   }
 }
 
 /******************************************************************************/
 
+/*
+ * Only a new size clears the table: the first row and column stay zero and
+ * the other entries are overwritten by the caller.
+ */
+template <typename T>
+void SummedAreaTables<T>::allocate(int height, int width) {
+  if (width == 0) throw std::logic_error("Image with width == 0 are not supported");
+  if (height == 0) throw std::logic_error("Image with height == 0 are not supported");
+
+  if (width != w || height != h || sum.empty()) {
+    w = width;
+    h = height;
+
+    sum.assign((w + 1) * (h + 1), T());
+  }
+}
+
+/******************************************************************************/
+
+template <typename T>
+void SummedAreaTables<T>::computeRows(const cv::Mat& mat, int minRow, int maxRow) {
+  if (mat.depth() == CV_8U)
+    computeRowsFrom<uint8_t>(mat, minRow, maxRow);
+  else
+    computeRowsFrom<T>(mat, minRow, maxRow);
+}
+
+/******************************************************************************/
+
+template <typename T>
+template <typename U>
+void SummedAreaTables<T>::computeRowsFrom(const cv::Mat& mat, int minRow, int maxRow) {
+  for (int row = minRow; row < maxRow; ++row) {
+    const U* buffer = mat.ptr<U>(row);
+          T* current = sum.data() + (row + 1) * (w + 1) + 1;
+
+    T rowSum = T();
+
+    for (int col = 0; col < w; ++col) {
+      rowSum += buffer[col];
+      current[col] = rowSum;
+    }
+  }
+}
+
+/******************************************************************************/
+
+template <typename T>
+void SummedAreaTables<T>::accumulateRows(int minCol, int maxCol) {
+  for (int row = 1; row < h; ++row) {
+    const T* above = sum.data() + row * (w + 1) + 1;
+          T* current = sum.data() + (row + 1) * (w + 1) + 1;
+
+    for (int col = minCol; col < maxCol; ++col)
+      current[col] += above[col];
+  }
+}
+
+/******************************************************************************/
+
 template <typename T>
-SummedAreaTables<T>::~SummedAreaTables() {
-  delete[] sum;
+inline T SummedAreaTables<T>::getUncheckedIntegral(int row, int col) const {
+  return sum[(row + 1) * (w + 1) + (col + 1)];
 }
 
 /******************************************************************************/
@@ -60,7 +155,7 @@ inline T SummedAreaTables<T>::getIntegral(int row, int col) const {
   if (row < 0) return T();
   if (col < 0) return T();
 
-  return sum[std::min(row, h - 1) * w + std::min(col, w - 1)];
+  return getUncheckedIntegral(std::min(row, h - 1), std::min(col, w - 1));
 }
 
 /******************************************************************************/
@@ -0,0 +1,157 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* ========================================================================== *
+ * ThreadPool                                                                 *
+ * ========================================================================== */
+
+/*
+ * Persistent workers sharing the iterations of parallel loops. The range of a
+ * loop is cut into chunks that the workers and the calling thread take in
+ * turn, and parallelFor() returns once all of them are processed. The workers
+ * are created once and sleep between two loops. Several threads may share a
+ * pool: a loop started while the workers are busy with another one is
+ * processed by its calling thread alone, which gives the same result. So is a
+ * loop started by a body on the pool processing it.
+ */
+class ThreadPool {
+  public:
+
+    /*
+     * Reference to the body of a loop, which only lives during the loop: a
+     * lambda is passed as is, without being copied into a std::function,
+     * which would allocate its captures on the heap at every loop.
+     */
+    class Body {
+      private:
+
+        void (*call)(const void*, size_t, size_t);
+        const void* callable;
+
+      public:
+
+        template <typename Callable>
+        Body(const Callable& callable) :
+          call(&invoke<Callable>), callable(&callable) {}
+
+        void operator()(size_t begin, size_t end) const {
+          call(callable, begin, end);
+        }
+
+      private:
+
+        template <typename Callable>
+        static void invoke(const void* callable, size_t begin, size_t end) {
+          (*static_cast<const Callable*>(callable))(begin, end);
+        }
+    };
+
+  private:
+
+    std::vector<std::thread> workers;
+
+    std::mutex callers;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::condition_variable done;
+
+    const Body* body;
+    size_t end;
+    size_t chunk;
+    std::atomic<size_t> next;
+
+    size_t generation;
+    size_t active;
+    bool stopped;
+    std::exception_ptr error;
+
+  public:
+
+    /* Uses threads threads including the caller, or all the cores if 0. */
+    explicit ThreadPool(size_t threads);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /* Number of threads including the caller. */
+    size_t size() const { return workers.size() + 1; }
+
+    /*
+     * Calls body(chunkBegin, chunkEnd) over chunks covering [begin, end), the
+     * bounds of the chunks being multiples of grain away from begin. The first
+     * exception thrown by a body is rethrown once all the chunks are done.
+     */
+    void parallelFor(size_t begin, size_t end, const Body& body, size_t grain = 1);
+
+    /* Same as parallelFor(), in the calling thread if pool is NULL. */
+    static void run(
+      ThreadPool* pool,
+      size_t begin,
+      size_t end,
+      const Body& body,
+      size_t grain = 1
+    );
+
+    /* Number of bands of runBands() over count iterations, 1 if pool is NULL. */
+    static size_t getBands(ThreadPool* pool, size_t count) {
+      size_t band = getBandSize(pool, count);
+      return (count + band - 1) / band;
+    }
+
+    /*
+     * Same as run() over bands of consecutive iterations, one per thread,
+     * calling body(band, bandBegin, bandEnd) with the index of the band among
+     * the getBands() ones, so that each band can use a scratch buffer of its
+     * own. A call may cover several consecutive bands, given the index of the
+     * first one, as when the loop is processed by its calling thread alone.
+     */
+    template <typename Callable>
+    static void runBands(ThreadPool* pool, size_t begin, size_t end, const Callable& body) {
+      size_t band = getBandSize(pool, end - begin);
+
+      /* The chunks of a grain of band are the bands themselves. */
+      run(pool, begin, end, [&](size_t chunkBegin, size_t chunkEnd) {
+        body((chunkBegin - begin) / band, chunkBegin, chunkEnd);
+      }, band);
+    }
+
+  protected:
+
+    static size_t getBandSize(ThreadPool* pool, size_t count) {
+      size_t threads = (pool != NULL) ? pool->size() : 1;
+      return std::max((count + threads - 1) / threads, static_cast<size_t>(1));
+    }
+
+    void work();
+
+    void process();
+};
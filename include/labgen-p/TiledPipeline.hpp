@@ -0,0 +1,117 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "History.hpp"
+#include "ThreadPool.hpp"
+
+/* ========================================================================== *
+ * TiledPipeline                                                              *
+ * ========================================================================== */
+
+/*
+ * Motion scores, quantities of motion, and insertion into pixel-level
+ * histories fused into a single pass over tiles of consecutive rows, so that
+ * the quantities of motion of a row are inserted while they are still in the
+ * cache instead of going through whole-frame maps and summed area tables.
+ *
+ * The motion scores of a tile and of its halo, the kernelSize / 2 rows above
+ * and below it for the largest kernel, are computed once and shared by all the
+ * kernel sizes. The box sums of each kernel size are then computed by sliding
+ * a vertical window down the tile: the sums of the motion scores over the
+ * columns of the window are started from the halo around the first row of the
+ * tile, then updated with one row entering and one row leaving the window per
+ * row, and summed horizontally over the kernel. The pixels outside of the
+ * image count as zeros, so that the quantities of motion are exactly the ones
+ * of MotionProba.
+ *
+ * The tiles are independent, and are processed concurrently given a thread
+ * pool. Since the scores of a halo are computed by both of the tiles it
+ * overlaps, the number of tiles is capped so that the halo does not exceed
+ * the height of a tile, which bounds the scores computed to three times the
+ * ones of the frame. The sums of the columns and the scores of all the tiles
+ * are kept from frame to frame, and only reallocated when the size changes.
+ */
+class TiledPipeline {
+  private:
+
+    std::vector<int32_t> kernelSizes;
+    size_t tiles;
+    ThreadPool* pool;
+
+    /* Sums of the columns of each tile and kernel size, in this order. */
+    std::vector<int32_t> columns;
+
+    /* Motion scores of the rows of each tile and of its halo. */
+    std::vector<uint8_t> scores;
+
+  public:
+
+    TiledPipeline(
+      const std::vector<int32_t>& kernelSizes,
+      size_t tiles,
+      ThreadPool* pool = NULL
+    );
+
+    /*
+     * Computes the quantities of motion between the CV_8UC1 lumas of two
+     * consecutive frames into the allocated quantities, one CV_16UC1 or
+     * CV_32SC1 matrix per kernel size, and inserts them along with the
+     * interleaved colors into the history of the same kernel size. Returns
+     * the number of pixels whose history has been modified, summed over the
+     * kernel sizes.
+     */
+    size_t process(
+      const cv::Mat& luma,
+      const cv::Mat& previous,
+      const cv::Mat& colors,
+      std::vector<cv::Mat>& quantities,
+      std::vector<std::shared_ptr<BasePatchesHistory> >& histories
+    );
+
+    size_t getTiles() const { return tiles; }
+
+    /* Number of tiles actually processed for frames of the given height. */
+    size_t getTiles(int height) const;
+
+  protected:
+
+    /* Largest kernelSize / 2, the height of the halos. */
+    int getHalo() const;
+
+    /* Rows [begin, end) of the image, and their halo. */
+    size_t processTile(
+      const cv::Mat& luma,
+      const cv::Mat& previous,
+      const cv::Mat& colors,
+      std::vector<cv::Mat>& quantities,
+      std::vector<std::shared_ptr<BasePatchesHistory> >& histories,
+      int begin,
+      int end,
+      int32_t* columns,
+      uint8_t* scores
+    ) const;
+};
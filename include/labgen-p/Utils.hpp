@@ -18,9 +18,9 @@
  */
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
 #include <string>
-#include <vector>
 
 #include <opencv2/core/core.hpp>
 
@@ -29,7 +29,73 @@
  * ========================================================================== */
 
 struct Utils {
-  typedef std::vector<cv::Rect>                                           ROIs;
+  /*
+   * Grid of rows x cols ROIs covering a height x width image, the ROIs being
+   * numbered row by row. The rects are computed on demand: if the modulo X of
+   * a dimension divided by the number of ROIs along it is superior to 0, then
+   * it is distributed among the X first ROIs.
+   */
+  struct ROIs {
+    size_t height;
+    size_t width;
+    size_t rows;
+    size_t cols;
+
+    /**************************************************************************/
+
+    ROIs(size_t height, size_t width, size_t rows, size_t cols) :
+    height(height), width(width), rows(rows), cols(cols) {}
+
+    /**************************************************************************/
+
+    size_t size() const { return rows * cols; }
+
+    /**************************************************************************/
+
+    bool isPixelLevel() const { return rows == height && cols == width; }
+
+    /**************************************************************************/
+
+    cv::Rect operator[](size_t num) const {
+      size_t i = num / cols;
+      size_t j = num % cols;
+
+      return cv::Rect(
+        getOffset(j, width, cols),
+        getOffset(i, height, rows),
+        getOffset(j + 1, width, cols) - getOffset(j, width, cols),
+        getOffset(i + 1, height, rows) - getOffset(i, height, rows)
+      );
+    }
+
+    /**************************************************************************/
+
+    /* Number of the ROI holding the pixel (y, x). */
+    size_t getIndex(size_t y, size_t x) const {
+      return getSegment(y, height, rows) * cols + getSegment(x, width, cols);
+    }
+
+    /**************************************************************************/
+
+    /* Position of the segment num out of segments along a length. */
+    static size_t getOffset(size_t num, size_t length, size_t segments) {
+      return num * (length / segments) + std::min(num, length % segments);
+    }
+
+    /**************************************************************************/
+
+    /* Segment holding the position pos along a length, see getOffset(). */
+    static size_t getSegment(size_t pos, size_t length, size_t segments) {
+      size_t segment = length / segments;
+      size_t reminder = length % segments;
+      size_t larger = reminder * (segment + 1);
+
+      if (pos < larger)
+        return pos / (segment + 1);
+
+      return reminder + (pos - larger) / segment;
+    }
+  };
 
   /****************************************************************************/
 
@@ -43,57 +109,13 @@ struct Utils {
   /****************************************************************************/
 
   /*
-   * If the modulo X of a dimension divided by the number of segments is
-   * superior to 0, then it is distributed among the X first patches.
+   * Grid of segments x segments patches, or pixel level if segments is 0.
    */
   static ROIs getROIs(size_t height, size_t width, size_t segments) {
     if (segments == 0)
       return getROIs(height, width);
 
-    ROIs rois;
-    rois.reserve(segments * segments);
-
-    size_t patchHeight = height / segments;
-    size_t hReminder = height % segments;
-
-    size_t patchWidth = width / segments;
-    size_t wReminder = width % segments;
-
-    /* Algorithm. */
-    size_t hReminderTmp = hReminder;
-    size_t previousY = 0;
-    size_t previousHeight = 0;
-
-    for (size_t i = 0; i < segments; ++i) {
-      size_t wReminderTmp = wReminder;
-      size_t previousX = 0;
-      size_t previousWidth = 0;
-
-      for (size_t j = 0; j < segments; ++j) {
-        rois.push_back(
-          cv::Rect(
-            (j == 0) ? 0 : (previousX + previousWidth),
-            (i == 0) ? 0 : (previousY + previousHeight),
-            patchWidth  + ((wReminderTmp > 0) ? 1 : 0),
-            patchHeight + ((hReminderTmp > 0) ? 1 : 0)
-          )
-        );
-
-        previousX = rois.back().x;
-        previousWidth = rois.back().width;
-
-        if (wReminderTmp > 0)
-          --wReminderTmp;
-      }
-
-      previousY = rois.back().y;
-      previousHeight = rois.back().height;
-
-      if (hReminderTmp > 0)
-        --hReminderTmp;
-    }
-
-    return rois;
+    return ROIs(height, width, segments, segments);
   }
 
   /****************************************************************************/
@@ -102,14 +124,6 @@ struct Utils {
    * Pixel level.
    */
   static ROIs getROIs(size_t height, size_t width) {
-    ROIs rois;
-    rois.reserve(height * width);
-
-    for (size_t i = 0; i < height; ++i) {
-      for (size_t j = 0; j < width; ++j)
-        rois.push_back(cv::Rect(j, i, 1, 1));
-    }
-
-    return rois;
+    return ROIs(height, width, height, width);
   }
 };
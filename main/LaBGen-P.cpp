@@ -17,22 +17,45 @@
  * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <condition_variable>
 #include <cstddef>
+#include <exception>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 
 #include <boost/program_options.hpp>
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
-#include <labgen-p/FrameDifferenceC1L1.hpp>
+#include <labgen-p/AsyncDecoder.hpp>
+#include <labgen-p/BackgroundEmitter.hpp>
+#include <labgen-p/ConvergenceMonitor.hpp>
+#include <labgen-p/Decimation.hpp>
+#include <labgen-p/DeviceMotion.hpp>
+#include <labgen-p/FrameSource.hpp>
+#include <labgen-p/I420.hpp>
 #include <labgen-p/History.hpp>
-#include <labgen-p/MotionProba.hpp>
+#include <labgen-p/LaBGenP.hpp>
+#include <labgen-p/MotionCache.hpp>
+#include <labgen-p/ThreadPool.hpp>
 #include <labgen-p/Utils.hpp>
 
 using namespace cv;
@@ -40,6 +63,1238 @@ using namespace std;
 using namespace boost;
 using namespace boost::program_options;
 
+/******************************************************************************
+ * Parameters                                                                 *
+ ******************************************************************************/
+
+/* Parameters shared by all the sequences processed by a run. */
+struct Parameters {
+  LaBGenP::Parameters engine;
+  bool visualization;
+  int32_t buffers;
+  int32_t stride;
+  double convergence;
+  int32_t patience;
+  int32_t emitFrames;
+  double emitSeconds;
+  int32_t checkpointFrames;
+  bool resume;
+  bool accuracy;
+  bool stats;
+  string motionCache;
+  int32_t motionCacheLevel;
+};
+
+/******************************************************************************
+ * Visualization                                                              *
+ ******************************************************************************/
+
+/*
+ * Windows of the visualization, showing the latest input frame, quantities of
+ * motion, and background published by the processing. They are shown by the
+ * thread calling show(), which must be the main thread on systems such as
+ * macOS, while the sequence is processed by another thread. publish() only
+ * copies the images into a buffer, replacing the ones not shown yet, and
+ * isDue() limits the publications to RATE per second, so that the processing
+ * never waits for the windows.
+ */
+class Preview {
+  public:
+
+    /* Largest number of publications per second. */
+    static const int32_t RATE = 10;
+
+  private:
+
+    Mat frame;
+    Mat quantities;
+    Mat background;
+    bool hasPending;
+    bool finished;
+
+    /* Only read and written by the processing thread. */
+    chrono::steady_clock::time_point lastPublication;
+
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+
+  public:
+
+    Preview() :
+    frame(),
+    quantities(),
+    background(),
+    hasPending(false),
+    finished(false),
+    lastPublication(chrono::steady_clock::now() - chrono::seconds(1)) {}
+
+    /* Whether the next images can be published. */
+    bool isDue() const {
+      return
+        chrono::steady_clock::now() - lastPublication >=
+        chrono::milliseconds(1000 / RATE);
+    }
+
+    void publish(const Mat& newFrame, const Mat& newQuantities, const Mat& newBackground) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        /* The buffers are reallocated only if the sizes change. */
+        newFrame.copyTo(frame);
+        newQuantities.copyTo(quantities);
+        newBackground.copyTo(background);
+        hasPending = true;
+      }
+
+      lastPublication = chrono::steady_clock::now();
+      wakeUp.notify_one();
+    }
+
+    /* The processing is over, show() returns once the last images are shown. */
+    void finish() {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+      }
+
+      wakeUp.notify_one();
+    }
+
+    /*
+     * Shows the images as they are published, until finish(). The events of
+     * the windows are handled between the publications as well.
+     */
+    void show() {
+      Mat shownFrame;
+      Mat shownQuantities;
+      Mat shownBackground;
+
+      for (;;) {
+        bool received = false;
+
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          wakeUp.wait_for(lock, chrono::milliseconds(10), [this] {
+            return hasPending || finished;
+          });
+
+          if (hasPending) {
+            std::swap(frame, shownFrame);
+            std::swap(quantities, shownQuantities);
+            std::swap(background, shownBackground);
+
+            hasPending = false;
+            received = true;
+          }
+          else if (finished)
+            break;
+        }
+
+        if (received) {
+          imshow("Input video", shownFrame);
+          imshow("Quantities of motion", shownQuantities);
+          imshow("Estimated background", shownBackground);
+        }
+
+        cvWaitKey(1);
+      }
+    }
+};
+
+/******************************************************************************
+ * Processing of a sequence                                                   *
+ ******************************************************************************/
+
+/*
+ * Computes the backgrounds of all the (S, N) pairs and writes them. Returns the
+ * time spent writing them, in seconds, and adds the time spent computing them
+ * to medians when given.
+ */
+static double writeBackgrounds(
+  const LaBGenP& engine,
+  const string& outputPath,
+  ostream& log,
+  double* medians = NULL
+) {
+  const vector<int32_t>& sParams = engine.getParameters().sParams;
+  const vector<int32_t>& nParams = engine.getParameters().nParams;
+
+  Mat background;
+  chrono::steady_clock::duration writing = chrono::steady_clock::duration::zero();
+
+  for (size_t n = 0; n < nParams.size(); ++n) {
+    for (size_t i = 0; i < sParams.size(); ++i) {
+      stringstream outputFile;
+      outputFile << outputPath << "/output_" << sParams[i] << "_" << nParams[n] << ".png";
+
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      engine.getBackground(background, sParams[i], nParams[n]);
+
+      if (medians != NULL)
+        *medians += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+      log << "Writing " << outputFile.str() << "..." << endl;
+
+      start = chrono::steady_clock::now();
+      imwrite(outputFile.str(), background);
+      writing += chrono::steady_clock::now() - start;
+    }
+  }
+
+  return chrono::duration<double>(writing).count();
+}
+
+/******************************************************************************/
+
+/* Peak resident memory of the process, in bytes. */
+static size_t getPeakMemory() {
+  struct rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+
+#ifdef __APPLE__
+  return static_cast<size_t>(usage.ru_maxrss);
+#else
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif /* __APPLE__ */
+}
+
+/******************************************************************************/
+
+/* Statistics of the processing of a sequence, besides the ones of the engine. */
+struct RunStatistics {
+  double seconds;
+  double decode;
+  double wait;
+  double write;
+
+  /* Medians of the backgrounds written, not timed by the engine. */
+  double medians;
+
+  /* Number of history replacements of each frame pushed. */
+  vector<size_t> replacements;
+
+  /**************************************************************************/
+
+  RunStatistics() : seconds(0), decode(0), wait(0), write(0), medians(0), replacements() {}
+};
+
+/******************************************************************************/
+
+/*
+ * Writes the statistics of a run as a JSON object. The times are in seconds,
+ * the memory in bytes.
+ */
+static void writeStatistics(
+  const string& path,
+  const LaBGenP& engine,
+  const RunStatistics& stats
+) {
+  ofstream stream(path.c_str());
+
+  if (!stream)
+    throw runtime_error("Cannot create " + path + ".");
+
+  const LaBGenP::Timings& timings = engine.getTimings();
+  size_t frames = stats.replacements.size();
+
+  stream << setprecision(9)
+         << "{" << endl
+         << "  \"height\": " << engine.getHeight() << "," << endl
+         << "  \"width\": " << engine.getWidth() << "," << endl
+         << "  \"frames\": " << frames << "," << endl
+         << "  \"seconds\": " << stats.seconds << "," << endl
+         << "  \"fps\": " << (stats.seconds > 0 ? frames / stats.seconds : 0) << "," << endl
+         << "  \"stages\": {" << endl
+         << "    \"decode\": " << stats.decode << "," << endl
+         << "    \"decode_wait\": " << stats.wait << "," << endl
+         << "    \"difference\": " << timings.difference << "," << endl
+         << "    \"filtering\": " << timings.filtering << "," << endl
+         << "    \"insertion\": " << timings.insertion << "," << endl
+         << "    \"median\": " << (timings.median + stats.medians) << "," << endl
+         << "    \"write\": " << stats.write << endl
+         << "  }," << endl
+         << "  \"peak_rss_bytes\": " << getPeakMemory() << "," << endl
+         << "  \"history_bytes\": " << engine.getHistoriesMemory() << "," << endl
+         << "  \"replacements\": [";
+
+  for (size_t i = 0; i < frames; ++i)
+    stream << (i ? ", " : "") << stats.replacements[i];
+
+  stream << "]" << endl
+         << "}" << endl;
+
+  if (!stream)
+    throw runtime_error("Cannot write " + path + ".");
+}
+
+/******************************************************************************/
+
+/*
+ * Compares the backgrounds of all the (S, N) pairs of an engine with the ones
+ * of a reference engine fed with the same frames, which computes the
+ * quantities of motion at full resolution. The mean absolute difference of
+ * the color components, the rate of pixels that differ, and the PSNR are
+ * reported.
+ */
+static void reportAccuracy(
+  const LaBGenP& engine,
+  const LaBGenP& reference,
+  ostream& log
+) {
+  const vector<int32_t>& sParams = engine.getParameters().sParams;
+  const vector<int32_t>& nParams = engine.getParameters().nParams;
+
+  Mat background;
+  Mat expected;
+
+  log << "Accuracy against the full resolution (downscale "
+      << engine.getParameters().downscale << "):" << endl;
+
+  for (size_t n = 0; n < nParams.size(); ++n) {
+    for (size_t i = 0; i < sParams.size(); ++i) {
+      engine.getBackground(background, sParams[i], nParams[n]);
+      reference.getBackground(expected, sParams[i], nParams[n]);
+
+      uint64_t sumAbs = 0;
+      uint64_t sumSquares = 0;
+      size_t differing = 0;
+
+      for (int32_t row = 0; row < background.rows; ++row) {
+        const uint8_t* actual = background.ptr<uint8_t>(row);
+        const uint8_t* wanted = expected.ptr<uint8_t>(row);
+
+        for (int32_t col = 0; col < background.cols; ++col) {
+          bool differs = false;
+
+          for (int32_t c = 0; c < CHANNELS; ++c, ++actual, ++wanted) {
+            int32_t diff = static_cast<int32_t>(*actual) - *wanted;
+
+            sumAbs += abs(diff);
+            sumSquares += diff * diff;
+            differs |= (diff != 0);
+          }
+
+          differing += differs;
+        }
+      }
+
+      size_t pixels = static_cast<size_t>(background.rows) * background.cols;
+      double mse = static_cast<double>(sumSquares) / (pixels * CHANNELS);
+
+      log << "  (S, N) = (" << sParams[i] << ", " << nParams[n] << "): "
+          << "mean absolute difference "
+          << static_cast<double>(sumAbs) / (pixels * CHANNELS) << ", "
+          << (100. * differing / pixels) << "% of pixels differ, PSNR ";
+
+      if (mse > 0)
+        log << (10 * log10(255. * 255. / mse)) << " dB" << endl;
+      else
+        log << "inf" << endl;
+    }
+  }
+
+  log << endl;
+}
+
+/******************************************************************************/
+
+/*
+ * Part of the key of a sequence of images given as a pattern such as
+ * path/%6d.png, the only pattern read by OpenCV: the indices of its first and
+ * last files, the first one being searched from 0 like OpenCV does, and a hash
+ * of the sizes and times of modification of all of them, so that the caches
+ * of a sequence whose images are modified are not replayed. Returns false if
+ * the sequence is not such a pattern.
+ */
+static bool getPatternKey(const string& sequence, string& patternKey) {
+  size_t percent = sequence.find('%');
+
+  if (percent == string::npos || sequence.find('%', percent + 1) != string::npos)
+    return false;
+
+  size_t spec = percent + 1;
+  char fill = ' ';
+
+  if (spec < sequence.size() && sequence[spec] == '0') {
+    fill = '0';
+    ++spec;
+  }
+
+  size_t type = sequence.find_first_not_of("0123456789", spec);
+
+  if (type == string::npos || sequence[type] != 'd')
+    return false;
+
+  int width = atoi(sequence.substr(spec, type - spec).c_str());
+  string prefix = sequence.substr(0, percent);
+  string suffix = sequence.substr(type + 1);
+
+  auto getPath = [&](size_t index) {
+    stringstream path;
+    path << prefix << setfill(fill) << setw(width) << index << suffix;
+
+    return path.str();
+  };
+
+  const size_t MAX_FIRST_INDEX = 1000;
+
+  size_t first = 0;
+  struct stat status;
+
+  while (first <= MAX_FIRST_INDEX && stat(getPath(first).c_str(), &status) != 0)
+    ++first;
+
+  if (first > MAX_FIRST_INDEX)
+    return false;
+
+  stringstream files;
+  size_t last = first;
+
+  for (; stat(getPath(last).c_str(), &status) == 0; ++last)
+    files << status.st_size << ":" << status.st_mtime << ";";
+
+  stringstream key;
+  key << " files=" << first << "-" << (last - 1)
+      << " hash=" << hex << MotionCache::getHash(files.str());
+
+  patternKey = key.str();
+
+  return true;
+}
+
+/******************************************************************************/
+
+/*
+ * Key of the motion cache of a sequence for the n-th value of N: everything
+ * its quantities of motion depend on, including the size and the time of
+ * modification of its file, or of the files of its images. The other inputs,
+ * such as cameras, cannot be identified and have no cache.
+ */
+static string getMotionKey(
+  const Parameters& params,
+  const string& sequence,
+  const LaBGenP& engine,
+  size_t n
+) {
+  const LaBGenP::Parameters& engineParams = engine.getParameters();
+
+  stringstream key;
+  key << "input=" << sequence;
+
+  struct stat status;
+  string patternKey;
+
+  if (stat(sequence.c_str(), &status) == 0 && S_ISREG(status.st_mode))
+    key << " bytes=" << status.st_size << " modified=" << status.st_mtime;
+  else if (getPatternKey(sequence, patternKey))
+    key << patternKey;
+  else {
+    throw runtime_error(
+      "The motion cache is only available for files and sequences of images!"
+    );
+  }
+
+  key << " size=" << engine.getWidth() << "x" << engine.getHeight()
+      << " format=" << engineParams.format
+      << " downscale=" << engineParams.downscale
+      << " stride=" << params.stride
+      << " n=" << engineParams.nParams[n]
+      << " type=" << engine.getReducedQuantitiesOfMotion()[n].type();
+
+  return key.str();
+}
+
+/******************************************************************************/
+
+/*
+ * Opens the motion caches of a sequence, one per value of N, in the folder of
+ * the parameters. When all of them are found, they are replayed, and the
+ * number of frames they all cover is returned, the quantities of motion of
+ * the following frames being computed. Otherwise, the missing ones are
+ * recorded when the sequence is processed from its start, and 0 is returned.
+ */
+static size_t openMotionCaches(
+  const Parameters& params,
+  const string& sequence,
+  const LaBGenP& engine,
+  vector<unique_ptr<MotionCache> >& caches,
+  vector<unique_ptr<MotionCacheWriter> >& writers,
+  ostream& log
+) {
+  const vector<int32_t>& nParams = engine.getParameters().nParams;
+  const vector<Mat>& quantities = engine.getReducedQuantitiesOfMotion();
+
+  vector<string> keys;
+  size_t frames = ~size_t(0);
+  bool complete = true;
+
+  for (size_t n = 0; n < nParams.size(); ++n) {
+    keys.push_back(getMotionKey(params, sequence, engine, n));
+
+    string path = MotionCache::getPath(params.motionCache, keys.back());
+    unique_ptr<MotionCache> cache;
+    struct stat status;
+
+    if (stat(path.c_str(), &status) == 0) {
+      cache.reset(new MotionCache(path));
+
+      /* Another sequence whose key has the same hash. */
+      if (
+        cache->getKey() != keys.back() ||
+        cache->getSize() != quantities[n].size() ||
+        cache->getType() != quantities[n].type()
+      )
+        cache.reset();
+    }
+
+    if (cache)
+      frames = min(frames, cache->getFrames());
+    else
+      complete = false;
+
+    caches.push_back(std::move(cache));
+  }
+
+  if (complete) {
+    log << "Replaying the quantities of motion of " << frames << " frames from "
+        << params.motionCache << "..." << endl;
+
+    return frames;
+  }
+
+  caches.clear();
+  writers.resize(nParams.size());
+
+  /* A resumed run does not see the first frames. */
+  if (engine.getNumFrames() > 0)
+    return 0;
+
+  for (size_t n = 0; n < nParams.size(); ++n) {
+    string path = MotionCache::getPath(params.motionCache, keys[n]);
+    struct stat status;
+
+    if (stat(path.c_str(), &status) != 0) {
+      writers[n].reset(new MotionCacheWriter(
+        path, keys[n], quantities[n].size(), quantities[n].type(), params.motionCacheLevel
+      ));
+    }
+  }
+
+  return 0;
+}
+
+/******************************************************************************/
+
+/*
+ * Writes the backgrounds of an opened sequence as outputPath/output_S_N.png,
+ * with an engine of the size of its frames. In online mode, the background of
+ * the first (S, N) pair is also written periodically during the processing as
+ * outputPath/background_S_N_frame.png. The state of the engine can be saved
+ * periodically and at the end as outputPath/checkpoint.lgp, and resumed from
+ * there, the frames it covers being skipped. With a downscale, the accuracy
+ * can be reported against a second engine working at full resolution. The
+ * statistics of the run can be written as outputPath/stats.json. The
+ * quantities of motion can be replayed from motion caches, or recorded into
+ * them, see openMotionCaches(). Given a preview, the images of the
+ * visualization are published to it.
+ */
+static void processSequence(
+  const Parameters& params,
+  const string& sequence,
+  FrameSource& source,
+  const string& outputPath,
+  LaBGenP& engine,
+  ostream& log,
+  Preview* preview = NULL
+) {
+  const vector<int32_t>& sParams = engine.getParameters().sParams;
+  const vector<int32_t>& nParams = engine.getParameters().nParams;
+
+  int32_t height     = engine.getHeight();
+  int32_t width      = engine.getWidth();
+
+  log << "          height: " << height     << endl;
+  log << "           width: " << width      << endl;
+
+  log << "Start processing..." << endl;
+
+  int32_t downscale = engine.getParameters().downscale;
+  int32_t motionSize = min(
+    Decimation::getReducedSize(height, downscale),
+    Decimation::getReducedSize(width, downscale)
+  );
+
+  for (size_t n = 0; n < nParams.size(); ++n) {
+    log << "Size of the kernel (N = " << nParams[n] << "): "
+        << ((motionSize / nParams[n]) | 1) << endl;
+  }
+
+  /* Full resolution engine the accuracy is reported against. */
+  std::unique_ptr<LaBGenP> reference;
+
+  if (params.accuracy && downscale > 1) {
+    LaBGenP::Parameters referenceParams = engine.getParameters();
+    referenceParams.downscale = 1;
+
+    reference.reset(new LaBGenP(height, width, referenceParams, engine.getPool()));
+  }
+
+  /* Initialization of the background matrix. */
+  Mat background = Mat(height, width, CV_8UC3);
+
+  /* Misc initializations. */
+  ConvergenceMonitor monitor(params.convergence, params.patience);
+  bool firstFrame = true;
+  int numFrame = -1;
+
+  /*
+   * Online mode. The snapshots are written by a separate thread, so that a
+   * slow disk drops snapshots instead of slowing down the processing.
+   */
+  bool online = (params.emitFrames > 0) || (params.emitSeconds > 0);
+  int32_t sOnline = sParams.front();
+  int32_t nOnline = nParams.front();
+
+  BackgroundEmitter emitter([=](const Mat& snapshot, size_t frame) {
+    stringstream snapshotFile;
+    snapshotFile << outputPath << "/background_" << sOnline << "_" << nOnline
+                 << "_" << setfill('0') << setw(6) << frame << ".png";
+
+    if (!imwrite(snapshotFile.str(), snapshot))
+      throw runtime_error("Cannot write " + snapshotFile.str() + ".");
+  });
+
+  int32_t framesSinceEmission = 0;
+  chrono::steady_clock::time_point lastEmission = chrono::steady_clock::now();
+
+  if (online)
+    emitter.start();
+
+  /* Checkpoints. */
+  string checkpointPath = outputPath + "/checkpoint.lgp";
+  int32_t framesSinceCheckpoint = 0;
+  struct stat checkpointStatus;
+
+  if (params.resume && stat(checkpointPath.c_str(), &checkpointStatus) == 0) {
+    engine.load(checkpointPath);
+    log << "Resuming from " << checkpointPath << " after "
+        << engine.getNumFrames() << " frames processed..." << endl;
+
+    /*
+     * The frames read so far are the ones pushed and the dropped second frame,
+     * each of them followed by stride - 1 skipped frames.
+     */
+    if (engine.getNumFrames() > 0) {
+      size_t framesRead = engine.getNumFrames() + 1;
+
+      for (size_t i = 0; i < framesRead * params.stride; ++i) {
+        if (!source.grab())
+          break;
+      }
+
+      firstFrame = false;
+      numFrame = framesRead - 1;
+    }
+  }
+
+  /* Motion caches. */
+  vector<unique_ptr<MotionCache> > caches;
+  vector<unique_ptr<MotionCacheWriter> > writers;
+  vector<Mat> cachedQuantities(nParams.size());
+  size_t cachedFrames = 0;
+
+  if (!params.motionCache.empty())
+    cachedFrames = openMotionCaches(params, sequence, engine, caches, writers, log);
+
+  /*
+   * Processing loop. The frames are decoded in a separate thread into a ring of
+   * buffers, so that decoding overlaps with processing and only a few frames
+   * are kept in memory whatever the sequence length.
+   */
+  log << endl << "Processing...";
+
+  RunStatistics stats;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  /* One replacement count per frame read, at most, when their number is known. */
+  if (params.stats)
+    stats.replacements.reserve((source.getFrameCount() + params.stride - 1) / params.stride);
+
+  AsyncDecoder reader(source, params.buffers, params.stride);
+  reader.start();
+
+  for (const Mat* frame; (frame = reader.acquire()) != NULL; reader.release()) {
+    ++numFrame;
+
+    /*
+     * Background subtraction and history update. The cached quantities of
+     * motion start with the ones of the second frame pushed.
+     */
+    size_t pushed = engine.getNumFrames() + 1;
+    bool replayed = (pushed >= 2 && pushed - 2 < cachedFrames);
+    size_t modified = 0;
+
+    if (replayed) {
+      for (size_t n = 0; n < nParams.size(); ++n)
+        cachedQuantities[n] = caches[n]->getQuantities(pushed - 2);
+
+      modified = engine.pushFrame(*frame, cachedQuantities);
+    }
+    else
+      modified = engine.pushFrame(*frame);
+
+    for (size_t n = 0; pushed >= 2 && n < writers.size(); ++n) {
+      if (writers[n])
+        writers[n]->write(engine.getReducedQuantitiesOfMotion()[n]);
+    }
+
+    if (params.stats)
+      stats.replacements.push_back(modified);
+
+    if (reference)
+      reference->pushFrame(*frame);
+
+    /*
+     * Skipping first frame. The frame following the first one has always been
+     * dropped as well, it is kept that way to produce the reference results.
+     */
+    if (firstFrame) {
+      log << "Skipping first frame..." << endl;
+
+      firstFrame = false;
+      reader.release();
+
+      if (reader.acquire() == NULL)
+        break;
+
+      ++numFrame;
+      continue;
+    }
+
+    /*
+     * Visualization of the input frame, its quantities of motion, and the
+     * first (S, N) pair, when the preview can take them. Only the medians of
+     * the pixels modified since the previous publication are recomputed.
+     */
+    if (preview != NULL && preview->isDue()) {
+      engine.updateBackground(background);
+
+      preview->publish(
+        (frame->channels() == 1) ? I420::getLuma(*frame) : *frame,
+        (replayed && downscale == 1) ?
+          cachedQuantities.front() : engine.getQuantitiesOfMotion(),
+        background
+      );
+    }
+
+    /*
+     * Periodic emission of the first (S, N) pair, sharing the incremental
+     * background with the visualization.
+     */
+    if (online) {
+      ++framesSinceEmission;
+      chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+      if (
+        (params.emitFrames > 0 && framesSinceEmission >= params.emitFrames) ||
+        (
+          params.emitSeconds > 0 &&
+          chrono::duration<double>(now - lastEmission).count() >= params.emitSeconds
+        )
+      ) {
+        engine.updateBackground(background);
+        emitter.emit(background, numFrame + 1);
+
+        framesSinceEmission = 0;
+        lastEmission = now;
+      }
+    }
+
+    /* Periodic checkpoint. */
+    if (params.checkpointFrames > 0 && ++framesSinceCheckpoint >= params.checkpointFrames) {
+      engine.save(checkpointPath);
+      framesSinceCheckpoint = 0;
+    }
+
+    /* Early termination once the histories barely change anymore. */
+    if (monitor.update(modified, nParams.size() * height * width)) {
+      log << "Converged after " << (numFrame + 1) << " frames." << endl;
+      break;
+    }
+  }
+
+  reader.stop();
+  source.release();
+  log << (numFrame + 1) << " frames read." << endl << endl;
+
+  for (size_t n = 0; n < writers.size(); ++n) {
+    if (writers[n]) {
+      log << "Writing the motion cache of N = " << nParams[n] << " ("
+          << writers[n]->getFrames() << " frames)..." << endl;
+      writers[n]->close();
+    }
+  }
+
+  if (online) {
+    emitter.stop();
+    log << emitter.getDropped() << " snapshots dropped." << endl;
+  }
+
+  if (params.checkpointFrames > 0) {
+    log << "Writing " << checkpointPath << "..." << endl;
+    engine.save(checkpointPath);
+  }
+
+  if (reference)
+    reportAccuracy(engine, *reference, log);
+
+  stats.write = writeBackgrounds(engine, outputPath, log, &stats.medians);
+
+  if (params.stats) {
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    stats.decode = reader.getDecodeTime();
+    stats.wait = reader.getWaitTime();
+
+    log << "Writing " << outputPath << "/stats.json..." << endl;
+    writeStatistics(outputPath + "/stats.json", engine, stats);
+  }
+}
+
+/******************************************************************************/
+
+/*
+ * Estimation of the memory needed to process a sequence, in bytes, including
+ * the frames decoded ahead.
+ */
+static size_t getMemory(const Parameters& params, int32_t height, int32_t width) {
+  size_t memory =
+    LaBGenP::getMemory(params.engine, height, width) +
+    static_cast<size_t>(height) * width * CHANNELS * (1 + params.buffers);
+
+  if (params.accuracy && params.engine.downscale > 1) {
+    LaBGenP::Parameters referenceParams = params.engine;
+    referenceParams.downscale = 1;
+
+    memory += LaBGenP::getMemory(referenceParams, height, width);
+  }
+
+  return memory;
+}
+
+/******************************************************************************
+ * Batch mode                                                                 *
+ ******************************************************************************/
+
+struct BatchEntry {
+  string input;
+  string name;
+};
+
+/******************************************************************************/
+
+/*
+ * Name of a sequence: the name of its file without extension, or the name of
+ * its folder for a pattern of images such as folder/in%6d.png.
+ */
+static string getSequenceName(const string& input) {
+  if (input.find('%') == string::npos)
+    return Utils::getMethod(input);
+
+  size_t pos = input.rfind("/");
+
+  if (pos == string::npos || pos == 0)
+    return Utils::getMethod(input);
+
+  return Utils::getMethod(input.substr(0, pos) + ".");
+}
+
+/******************************************************************************/
+
+/*
+ * The sequences of a batch are either the files of a folder, or the lines of
+ * a manifest made of an input optionally followed by a name. Empty lines and
+ * lines starting with # are ignored in a manifest.
+ */
+static vector<BatchEntry> getBatch(const string& path) {
+  vector<BatchEntry> entries;
+  struct stat status;
+
+  if (stat(path.c_str(), &status) != 0)
+    throw runtime_error("Cannot access the '" + path + "' batch.");
+
+  if (S_ISDIR(status.st_mode)) {
+    DIR* folder = opendir(path.c_str());
+
+    if (folder == NULL)
+      throw runtime_error("Cannot open the '" + path + "' folder.");
+
+    for (struct dirent* entry; (entry = readdir(folder)) != NULL;) {
+      string file(path + "/" + entry->d_name);
+
+      if (entry->d_name[0] == '.' || stat(file.c_str(), &status) != 0)
+        continue;
+
+      if (S_ISREG(status.st_mode)) {
+        BatchEntry batchEntry = { file, getSequenceName(file) };
+        entries.push_back(batchEntry);
+      }
+    }
+
+    closedir(folder);
+
+    sort(entries.begin(), entries.end(), [](const BatchEntry& a, const BatchEntry& b) {
+      return a.input < b.input;
+    });
+  }
+  else {
+    ifstream manifest(path.c_str());
+
+    if (!manifest)
+      throw runtime_error("Cannot open the '" + path + "' manifest.");
+
+    for (string line; getline(manifest, line);) {
+      istringstream fields(line);
+      BatchEntry entry;
+
+      if (!(fields >> entry.input) || entry.input[0] == '#')
+        continue;
+
+      if (!(fields >> entry.name))
+        entry.name = getSequenceName(entry.input);
+
+      entries.push_back(entry);
+    }
+  }
+
+  for (size_t i = 0; i < entries.size(); ++i) {
+    for (size_t j = i + 1; j < entries.size(); ++j) {
+      if (entries[i].name == entries[j].name)
+        throw runtime_error("Two sequences are named '" + entries[i].name + "'.");
+    }
+  }
+
+  return entries;
+}
+
+/******************************************************************************/
+
+/*
+ * Bytes of memory reserved by the sequences being processed, bounded by a
+ * limit (0 for none). A reservation exceeding the limit alone is granted when
+ * nothing else is reserved.
+ */
+class MemoryBudget {
+  private:
+
+    size_t limit;
+    size_t used;
+
+    std::mutex mutex;
+    std::condition_variable released;
+
+  public:
+
+    MemoryBudget(size_t limit) : limit(limit), used(0) {}
+
+    void acquire(size_t bytes) {
+      std::unique_lock<std::mutex> lock(mutex);
+
+      released.wait(lock, [this, bytes] {
+        return limit == 0 || used == 0 || used + bytes <= limit;
+      });
+
+      used += bytes;
+    }
+
+    void release(size_t bytes) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        used -= bytes;
+      }
+
+      released.notify_all();
+    }
+};
+
+/******************************************************************************/
+
+/*
+ * Saves the log of a sequence of a batch into its output folder, if it could
+ * be created. Nothing is thrown, so that a failure is still reported.
+ */
+static void writeLog(const string& outputPath, const stringstream& log) {
+  ofstream stream((outputPath + "/log.txt").c_str());
+
+  if (stream)
+    stream << log.str();
+}
+
+/******************************************************************************/
+
+/*
+ * Processes the sequences of a batch with up to jobs sequences at a time, the
+ * backgrounds of a sequence being written into output/name along with the log
+ * of its processing, log.txt, which is also printed if the sequence fails.
+ * Each job keeps its engine, and thus its memory reservation, from one sequence
+ * to the next one of the same resolution. Returns the number of sequences that
+ * failed.
+ */
+static size_t processBatch(
+  const Parameters& params,
+  const vector<BatchEntry>& entries,
+  const string& output,
+  size_t jobs,
+  size_t memory,
+  ThreadPool* pool
+) {
+  MemoryBudget budget(memory);
+  std::atomic<size_t> next(0);
+  std::atomic<size_t> failures(0);
+  std::mutex logMutex;
+
+  auto job = [&]() {
+    std::unique_ptr<LaBGenP> engine;
+    size_t reserved = 0;
+
+    for (size_t num; (num = next++) < entries.size();) {
+      const BatchEntry& entry = entries[num];
+      string outputPath(output + "/" + entry.name);
+      stringstream log;
+
+      try {
+        VideoCapture decoder(entry.input);
+
+        if (!decoder.isOpened())
+          throw runtime_error("Cannot open the '" + entry.input + "' sequence.");
+
+        int32_t height = decoder.get(CV_CAP_PROP_FRAME_HEIGHT);
+        int32_t width  = decoder.get(CV_CAP_PROP_FRAME_WIDTH);
+
+        if (engine && height == engine->getHeight() && width == engine->getWidth())
+          engine->reset();
+        else {
+          engine.reset();
+          budget.release(reserved);
+
+          reserved = getMemory(params, height, width);
+          budget.acquire(reserved);
+
+          engine.reset(new LaBGenP(height, width, params.engine, pool));
+        }
+
+        if (mkdir(outputPath.c_str(), 0755) != 0 && errno != EEXIST)
+          throw runtime_error("Cannot create the '" + outputPath + "' folder.");
+
+        VideoSource source(decoder);
+        processSequence(params, entry.input, source, outputPath, *engine, log);
+        writeLog(outputPath, log);
+
+        std::lock_guard<std::mutex> lock(logMutex);
+        cout << "[" << (num + 1) << "/" << entries.size() << "] " << entry.name
+             << " done." << endl;
+      }
+      catch (const std::exception& e) {
+        ++failures;
+
+        {
+          std::lock_guard<std::mutex> lock(logMutex);
+          cerr << "[" << (num + 1) << "/" << entries.size() << "] " << entry.name
+               << " failed: " << e.what() << endl << log.str();
+        }
+
+        log << endl << "Failed: " << e.what() << endl;
+        writeLog(outputPath, log);
+      }
+    }
+
+    budget.release(reserved);
+  };
+
+  vector<std::thread> workers;
+
+  for (size_t i = 1; i < jobs; ++i)
+    workers.push_back(std::thread(job));
+
+  job();
+
+  for (size_t i = 0; i < workers.size(); ++i)
+    workers[i].join();
+
+  return failures;
+}
+
+/******************************************************************************
+ * Sharded mode                                                               *
+ ******************************************************************************/
+
+/*
+ * Range [begin, end) of the frames decoded with the stride belonging to a
+ * shard, given the number of frames of the sequence. That number is only
+ * estimated by many containers, so that the last shard reads the sequence
+ * until its actual end instead of stopping at end. The shards following the first one start at the fourth frame at the
+ * earliest, since their first frame is preceded by the last frame of the
+ * previous shard, which must not be the dropped second frame of the sequence.
+ */
+static void getShardRange(
+  size_t shard,
+  size_t shards,
+  size_t frames,
+  size_t& begin,
+  size_t& end
+) {
+  size_t minBegin = min<size_t>(3, frames);
+
+  begin = Utils::ROIs::getOffset(shard, frames, shards);
+  end   = Utils::ROIs::getOffset(shard + 1, frames, shards);
+
+  if (shard > 0)
+    begin = max(begin, minBegin);
+
+  end = max(end, minBegin);
+}
+
+/******************************************************************************/
+
+/*
+ * Processes a shard of a sequence with a reset engine. The shards following
+ * the first one also read the last frame of the previous shard, which only
+ * initializes the frame difference, so that merging the engines of all the
+ * shards in order gives the engine of the whole sequence. The bounds of the
+ * shards come from the approximate number of frames of the sequence: the last
+ * shard reads all the remaining frames, and the other ones throw if the
+ * sequence ends before them.
+ */
+static void processShard(
+  const Parameters& params,
+  const string& sequence,
+  size_t shard,
+  size_t shards,
+  LaBGenP& engine
+) {
+  VideoCapture decoder(sequence);
+
+  if (!decoder.isOpened())
+    throw runtime_error("Cannot open the '" + sequence + "' sequence.");
+
+  double count = decoder.get(CV_CAP_PROP_FRAME_COUNT);
+
+  if (count < 1)
+    throw runtime_error("The number of frames of the sequence is unknown!");
+
+  size_t frames = (static_cast<size_t>(count) + params.stride - 1) / params.stride;
+  size_t begin, end;
+
+  getShardRange(shard, shards, frames, begin, end);
+
+  bool last = (shard + 1 == shards);
+
+  if (begin >= end && !last)
+    return;
+
+  size_t numFrame = (shard == 0) ? 0 : (begin - 1);
+  double position = static_cast<double>(numFrame * params.stride);
+
+  if (
+    numFrame > 0 && (
+      !decoder.set(CV_CAP_PROP_POS_FRAMES, position) ||
+      decoder.get(CV_CAP_PROP_POS_FRAMES) != position
+    )
+  )
+    throw runtime_error("Cannot seek in the '" + sequence + "' sequence.");
+
+  VideoSource source(decoder);
+  AsyncDecoder reader(source, params.buffers, params.stride);
+
+  reader.start();
+
+  for (
+    const Mat* frame;
+    (last || numFrame < end) && (frame = reader.acquire()) != NULL;
+    reader.release(), ++numFrame
+  ) {
+    /* The second frame of the sequence is dropped, see processSequence(). */
+    if (numFrame == 1)
+      continue;
+
+    engine.pushFrame(*frame);
+  }
+
+  reader.stop();
+
+  if (numFrame < end && !last) {
+    stringstream message;
+    message << "The '" << sequence << "' sequence ends before shard " << shard
+            << ", its number of frames being overestimated!";
+
+    throw runtime_error(message.str());
+  }
+}
+
+/******************************************************************************/
+
+/*
+ * Processes the shards of a sequence concurrently, one thread per shard, and
+ * merges them in order into the engine of the first shard.
+ */
+static void processShards(
+  const Parameters& params,
+  const string& sequence,
+  size_t shards,
+  LaBGenP& engine,
+  ThreadPool* pool
+) {
+  vector<std::unique_ptr<LaBGenP> > engines;
+
+  for (size_t shard = 1; shard < shards; ++shard) {
+    engines.push_back(std::unique_ptr<LaBGenP>(
+      new LaBGenP(engine.getHeight(), engine.getWidth(), params.engine, pool)
+    ));
+  }
+
+  vector<std::exception_ptr> errors(shards);
+  vector<std::thread> workers;
+
+  for (size_t shard = 1; shard < shards; ++shard) {
+    workers.push_back(std::thread([&, shard]() {
+      try {
+        processShard(params, sequence, shard, shards, *(engines[shard - 1]));
+      }
+      catch (...) {
+        errors[shard] = std::current_exception();
+      }
+    }));
+  }
+
+  try {
+    processShard(params, sequence, 0, shards, engine);
+  }
+  catch (...) {
+    errors[0] = std::current_exception();
+  }
+
+  for (size_t i = 0; i < workers.size(); ++i)
+    workers[i].join();
+
+  for (size_t shard = 0; shard < shards; ++shard) {
+    if (errors[shard])
+      std::rethrow_exception(errors[shard]);
+  }
+
+  for (size_t shard = 1; shard < shards; ++shard)
+    engine.merge(*(engines[shard - 1]));
+}
+
+/******************************************************************************/
+
+static string getShardPath(const string& output, size_t shard) {
+  stringstream path;
+  path << output << "/shard_" << shard << ".lgp";
+
+  return path.str();
+}
+
 /******************************************************************************
  * Main program                                                               *
  ******************************************************************************/
@@ -66,6 +1321,29 @@ int main(int argc, char** argv) {
       value<string>(),
       "path to the input sequence"
     )
+    (
+      "i420",
+      value<string>(),
+      "size WxH of the raw I420 frames of the input sequence, read as is "
+      "instead of being decoded (- for the standard input)"
+    )
+    (
+      "batch",
+      value<string>(),
+      "folder of input sequences, or manifest listing one input sequence per "
+      "line optionally followed by its name, processed instead of --input"
+    )
+    (
+      "jobs,j",
+      value<int32_t>()->default_value(1),
+      "number of sequences of a batch processed at the same time"
+    )
+    (
+      "memory",
+      value<int32_t>()->default_value(0),
+      "memory available to the sequences of a batch processed at the same "
+      "time, in MiB (0 for no limit)"
+    )
     (
       "output,o",
       value<string>(),
@@ -73,13 +1351,13 @@ int main(int argc, char** argv) {
     )
     (
       "s-parameter,s",
-      value<int32_t>()->multitoken(),
-      "value of the S parameter"
+      value<vector<int32_t> >()->multitoken(),
+      "value(s) of the S parameter"
     )
     (
       "n-parameter,n",
-      value<int32_t>(),
-      "value of the N parameter"
+      value<vector<int32_t> >()->multitoken(),
+      "value(s) of the N parameter"
     )
     (
       "default,d",
@@ -89,6 +1367,130 @@ int main(int argc, char** argv) {
       "visualization,v",
       "enable visualization"
     )
+    (
+      "buffers,b",
+      value<int32_t>()->default_value(4),
+      "number of frames decoded ahead of the processing"
+    )
+    (
+      "filter,f",
+      value<string>()->default_value("sat"),
+      "engine computing the quantities of motion (sat or separable)"
+    )
+    (
+      "device",
+      value<string>()->default_value("cpu"),
+      "where the quantities of motion are computed (cpu, or opencl when a "
+      "device is available)"
+    )
+    (
+      "segments",
+      value<int32_t>()->default_value(0),
+      "number of patches along each dimension (0 for pixel level)"
+    )
+    (
+      "tiles",
+      value<int32_t>()->default_value(0),
+      "number of tiles of rows processed in a single pass from the frame "
+      "difference to the histories, at pixel level without downscale (0 to "
+      "disable)"
+    )
+    (
+      "backing",
+      value<string>(),
+      "folder of the files backing the histories, which can then be paged out "
+      "to the disk"
+    )
+    (
+      "stride",
+      value<int32_t>()->default_value(1),
+      "process one frame out of stride"
+    )
+    (
+      "convergence,c",
+      value<double>()->default_value(0),
+      "stop once the rate of history replacements per frame stays below this "
+      "threshold (0 to disable)"
+    )
+    (
+      "patience",
+      value<int32_t>()->default_value(100),
+      "number of consecutive frames below the convergence threshold"
+    )
+    (
+      "emit-frames",
+      value<int32_t>()->default_value(0),
+      "write the current background every this number of frames (0 to disable)"
+    )
+    (
+      "emit-seconds",
+      value<double>()->default_value(0),
+      "write the current background every this number of seconds (0 to "
+      "disable)"
+    )
+    (
+      "aging",
+      value<int32_t>()->default_value(0),
+      "amount added to the quantities of motion of the stored samples after "
+      "each frame, so that old samples are replaced (0 to disable)"
+    )
+    (
+      "downscale",
+      value<int32_t>()->default_value(1),
+      "factor by which the frames are reduced to compute the quantities of "
+      "motion (1 for full resolution)"
+    )
+    (
+      "accuracy",
+      "report the accuracy of the downscale against the full resolution"
+    )
+    (
+      "checkpoint-every",
+      value<int32_t>()->default_value(0),
+      "save the state into the output folder every this number of frames and "
+      "at the end (0 to disable)"
+    )
+    (
+      "resume",
+      "resume from the state saved in the output folder, if any"
+    )
+    (
+      "shards",
+      value<int32_t>()->default_value(1),
+      "number of consecutive parts of the sequence processed concurrently, "
+      "then merged"
+    )
+    (
+      "shard",
+      value<int32_t>(),
+      "only process this part of the sequence among --shards, and save its "
+      "state into the output folder"
+    )
+    (
+      "merge",
+      "merge the states of the --shards parts saved into the output folder"
+    )
+    (
+      "stats",
+      "write the statistics of the run into stats.json in the output folder"
+    )
+    (
+      "motion-cache",
+      value<string>(),
+      "folder where the quantities of motion of each sequence and value of N "
+      "are stored, and replayed by later runs"
+    )
+    (
+      "motion-cache-level",
+      value<int32_t>()->default_value(1),
+      "compression level of the motion caches written, from 1 to 9, or 0 for "
+      "uncompressed maps read as is from the disk"
+    )
+    (
+      "threads,t",
+      value<int32_t>()->default_value(1),
+      "number of processing threads (0 for all the cores)"
+    )
   ;
 
   variables_map varsMap;
@@ -118,14 +1520,49 @@ int main(int argc, char** argv) {
    * Extract parameters and sanity check.
    */
 
-  int32_t sParam = 0;
-  int32_t nParam = 0;
+  /*
+   * Several values of S and N can be given: the sequence is processed once,
+   * and a background is written for each (S, N) pair.
+   */
+  vector<int32_t> sParams;
+  vector<int32_t> nParams;
 
-  /* "input" */
-  if (!varsMap.count("input"))
+  /* "input" and "batch" */
+  bool batchMode = varsMap.count("batch");
+  bool mergeMode = varsMap.count("merge");
+
+  if (!batchMode && !mergeMode && !varsMap.count("input"))
     throw runtime_error("You must provide the path of the input sequence!");
 
-  string sequence(varsMap["input"].as<string>());
+  if (batchMode && varsMap.count("input"))
+    throw runtime_error("You cannot provide both an input sequence and a batch!");
+
+  string sequence(
+    batchMode ? varsMap["batch"].as<string>() :
+    varsMap.count("input") ? varsMap["input"].as<string>() : string()
+  );
+
+  /* "i420" */
+  bool yuv = varsMap.count("i420");
+  int32_t yuvHeight = 0;
+  int32_t yuvWidth = 0;
+
+  if (yuv) {
+    const string& size = varsMap["i420"].as<string>();
+    char separator;
+
+    stringstream sizeStream(size);
+    sizeStream >> yuvWidth >> separator >> yuvHeight;
+
+    if (!sizeStream || !sizeStream.eof() || separator != 'x')
+      throw runtime_error("The size of the I420 frames must be given as WxH!");
+
+    if (yuvHeight < 2 || yuvWidth < 2 || yuvHeight % 2 != 0 || yuvWidth % 2 != 0)
+      throw runtime_error("The size of the I420 frames must be even and positive!");
+  }
+
+  if (yuv && batchMode)
+    throw runtime_error("The I420 frames are not available in batch mode!");
 
   /* "output" */
   if (!varsMap.count("output"))
@@ -137,8 +1574,8 @@ int main(int argc, char** argv) {
   bool defaultSet = varsMap.count("default");
 
   if (defaultSet) {
-    sParam = 19;
-    nParam = 3;
+    sParams.push_back(19);
+    nParams.push_back(3);
   }
 
   /* Other parameters. */
@@ -147,147 +1584,418 @@ int main(int argc, char** argv) {
     if (!varsMap.count("s-parameter"))
       throw runtime_error("You must provide the S parameter!");
 
-    sParam = varsMap["s-parameter"].as<int32_t>();
+    sParams = varsMap["s-parameter"].as<vector<int32_t> >();
 
-    if (sParam < 1)
-      throw runtime_error("The S parameter must be positive!");
+    for (size_t i = 0; i < sParams.size(); ++i) {
+      if (sParams[i] < 1)
+        throw runtime_error("The S parameter must be positive!");
+    }
 
     /* "n-parameter" */
     if (!varsMap.count("n-parameter"))
       throw runtime_error("You must provide the N parameter!");
 
-    nParam = varsMap["n-parameter"].as<int32_t>();
+    nParams = varsMap["n-parameter"].as<vector<int32_t> >();
 
-    if (nParam < 1)
-      throw runtime_error("The N parameter must be positive!");
+    for (size_t i = 0; i < nParams.size(); ++i) {
+      if (nParams[i] < 1)
+        throw runtime_error("The N parameter must be positive!");
+    }
   }
 
+  sort(sParams.begin(), sParams.end());
+  sParams.erase(unique(sParams.begin(), sParams.end()), sParams.end());
+
+  sort(nParams.begin(), nParams.end());
+  nParams.erase(unique(nParams.begin(), nParams.end()), nParams.end());
+
+  stringstream sList;
+  stringstream nList;
+
+  for (size_t i = 0; i < sParams.size(); ++i)
+    sList << (i ? " " : "") << sParams[i];
+
+  for (size_t i = 0; i < nParams.size(); ++i)
+    nList << (i ? " " : "") << nParams[i];
+
   /* "visualization" */
   bool visualization = varsMap.count("visualization");
 
-  /* Display parameters to the user. */
-  cout << "Input sequence: "      << sequence      << endl;
-  cout << "   Output path: "      << output        << endl;
-  cout << "             S: "      << sParam        << endl;
-  cout << "             N: "      << nParam      << endl;
-  cout << " Visualization: "      << visualization << endl;
-  cout << endl;
+  if (visualization && batchMode)
+    throw runtime_error("The visualization is not available in batch mode!");
 
-  /***************************************************************************
-   * Reading sequence.                                                       *
-   ***************************************************************************/
+  /* "buffers" */
+  int32_t buffers = varsMap["buffers"].as<int32_t>();
 
-  VideoCapture decoder(sequence);
+  if (buffers < 1)
+    throw runtime_error("The number of buffers must be positive!");
 
-  if (!decoder.isOpened())
-    throw runtime_error("Cannot open the '" + sequence + "' sequence.");
+  /* "filter" */
+  string filterEngine(varsMap["filter"].as<string>());
 
-  int32_t height     = decoder.get(CV_CAP_PROP_FRAME_HEIGHT);
-  int32_t width      = decoder.get(CV_CAP_PROP_FRAME_WIDTH);
+  if (filterEngine != "sat" && filterEngine != "separable")
+    throw runtime_error("The filter must be either sat or separable!");
 
-  cout << "Reading sequence " << sequence << "..." << endl;
+  /* "device" */
+  string device(varsMap["device"].as<string>());
 
-  cout << "          height: " << height     << endl;
-  cout << "           width: " << width      << endl;
+  if (device != "cpu" && device != "opencl")
+    throw runtime_error("The device must be either cpu or opencl!");
 
-  typedef vector<Mat>                                            FramesVec;
-  vector<Mat> frames;
-  frames.reserve(decoder.get(CV_CAP_PROP_FRAME_COUNT));
+  if (device == "opencl" && !DeviceMotion::isAvailable()) {
+    cerr << "No OpenCL device is available, the processor is used." << endl;
+    device = "cpu";
+  }
 
-  Mat frame;
+  /* "segments" */
+  int32_t segments = varsMap["segments"].as<int32_t>();
 
-  while (decoder.read(frame))
-    frames.push_back(frame.clone());
+  if (segments < 0)
+    throw runtime_error("The number of segments cannot be negative!");
 
-  decoder.release();
-  cout << frames.size() << " frames read." << endl << endl;
+  /* "tiles" and "backing" */
+  int32_t tiles = varsMap["tiles"].as<int32_t>();
+  string backing = varsMap.count("backing") ? varsMap["backing"].as<string>() : "";
 
-  /***************************************************************************
-   * Processing.                                                             *
-   ***************************************************************************/
+  if (tiles < 0)
+    throw runtime_error("The number of tiles cannot be negative!");
 
-  cout << "Start processing..." << endl;
+  /* "stride" */
+  int32_t stride = varsMap["stride"].as<int32_t>();
 
-  /* Initialization of the background matrix. */
-  Mat background = Mat(height, width, CV_8UC3);
+  if (stride < 1)
+    throw runtime_error("The stride must be positive!");
 
-  /* Initialization of the ROIs. */
-  Utils::ROIs rois = Utils::getROIs(height, width); // Pixel-level.
+  /* "convergence" */
+  double convergence = varsMap["convergence"].as<double>();
 
-  /* Initialization of the filter. */
-  CounterMotionProba filter((min(height, width) / nParam) | 1);
-  cout << "Size of the kernel: " << ((min(height, width) / nParam) | 1) << endl;
+  if (convergence < 0 || convergence > 1)
+    throw runtime_error("The convergence threshold must be in [0, 1]!");
 
-  /* Initialization of the maps matrices. */
-  Mat motionScores;
-  Mat quantitiesMotion;
+  /* "patience" */
+  int32_t patience = varsMap["patience"].as<int32_t>();
 
-  motionScores = Mat(height, width, CV_32SC1);
-  quantitiesMotion = Mat(height, width, filter.getOpenCVEncoding());
+  if (patience < 1)
+    throw runtime_error("The patience must be positive!");
 
-  /* Initialization of the history structure. */
-  std::shared_ptr<PatchesHistory> history = std::make_shared<PatchesHistory>(rois, sParam);
+  /* "emit-frames" */
+  int32_t emitFrames = varsMap["emit-frames"].as<int32_t>();
 
-  /* Misc initializations. */
-  std::shared_ptr<FrameDifferenceC1L1> fdiff;
-  bool firstFrame = true;
-  int numFrame = -1;
+  if (emitFrames < 0)
+    throw runtime_error("The emission period in frames cannot be negative!");
 
-  /* Processing loop. */
-  cout << endl << "Processing...";
+  /* "emit-seconds" */
+  double emitSeconds = varsMap["emit-seconds"].as<double>();
 
-  for (FramesVec::const_iterator it = frames.begin(), end = frames.end(); it != end; ++it) {
-    ++numFrame;
+  if (emitSeconds < 0)
+    throw runtime_error("The emission period in seconds cannot be negative!");
 
-    /* Algorithm instantiation. */
-    if (firstFrame)
-      fdiff = make_shared<FrameDifferenceC1L1>();
+  /* "aging" */
+  int32_t aging = varsMap["aging"].as<int32_t>();
 
-    /* Background subtraction. */
-    fdiff->process((*it).clone(), motionScores);
+  if (aging < 0)
+    throw runtime_error("The aging cannot be negative!");
 
-    /* Visualization of the input frame and its probability map. */
-    if (visualization)
-      imshow("Input video", (*it));
+  /* "downscale" and "accuracy" */
+  int32_t downscale = varsMap["downscale"].as<int32_t>();
+  bool accuracy = varsMap.count("accuracy");
 
-    /* Skipping first frame. */
-    if (firstFrame) {
-      cout << "Skipping first frame..." << endl;
+  if (downscale < 1)
+    throw runtime_error("The downscale factor must be positive!");
 
-      ++it;
-      firstFrame = false;
+  /* "checkpoint-every" */
+  int32_t checkpointFrames = varsMap["checkpoint-every"].as<int32_t>();
 
-      continue;
-    }
+  if (checkpointFrames < 0)
+    throw runtime_error("The checkpoint period cannot be negative!");
 
-    /* Filtering probability map. */
-    if (!motionScores.empty()) {
-      filter.compute(motionScores, quantitiesMotion);
+  /* "resume" */
+  bool resume = varsMap.count("resume");
 
-      if (visualization)
-        imshow("Quantities of motion", quantitiesMotion);
-    }
+  if (accuracy && resume)
+    throw runtime_error("The accuracy cannot be reported when resuming!");
+
+  /* "shards", "shard" and "merge" */
+  int32_t shards = varsMap["shards"].as<int32_t>();
+  int32_t shard = varsMap.count("shard") ? varsMap["shard"].as<int32_t>() : -1;
+
+  if (shards < 1)
+    throw runtime_error("The number of shards must be positive!");
+
+  if (varsMap.count("shard") && (shard < 0 || shard >= shards))
+    throw runtime_error("The shard must be in [0, shards)!");
+
+  if (varsMap.count("shard") && mergeMode)
+    throw runtime_error("You cannot both process a shard and merge the shards!");
+
+  bool sharded = (shards > 1) || varsMap.count("shard") || mergeMode;
+
+  if (sharded && yuv)
+    throw runtime_error("The sharded mode is not available for I420 frames!");
+
+  /* "stats" */
+  bool stats = varsMap.count("stats");
+
+  if (sharded && batchMode)
+    throw runtime_error("The sharded mode is not available in batch mode!");
+
+  if (
+    sharded && (
+      visualization || emitFrames > 0 || emitSeconds > 0 || convergence > 0 ||
+      checkpointFrames > 0 || resume || accuracy || stats
+    )
+  ) {
+    throw runtime_error(
+      "The sharded mode is not compatible with the visualization, the online "
+      "mode, the convergence, the checkpoints, the accuracy report, and the "
+      "statistics!"
+    );
+  }
+
+  /*
+   * The samples of a shard are not aged by the frames of the following shards,
+   * so that the merged histories would differ from the ones of the sequence.
+   */
+  if (aging > 0 && sharded)
+    throw runtime_error("The aging is not available in sharded mode!");
+
+  /* "motion-cache" */
+  string motionCache =
+    varsMap.count("motion-cache") ? varsMap["motion-cache"].as<string>() : "";
+
+  if (!motionCache.empty() && sharded)
+    throw runtime_error("The motion cache is not available in sharded mode!");
+
+  if (!motionCache.empty() && device == "opencl")
+    throw runtime_error("The motion cache is not available with a device!");
+
+  if (!motionCache.empty() && sequence == "-")
+    throw runtime_error("The motion cache is not available for the standard input!");
+
+  /* "motion-cache-level" */
+  int32_t motionCacheLevel = varsMap["motion-cache-level"].as<int32_t>();
+
+  if (motionCacheLevel < 0 || motionCacheLevel > 9)
+    throw runtime_error("The compression level of the motion cache must be between 0 and 9!");
+
+  /* "threads" */
+  int32_t threads = varsMap["threads"].as<int32_t>();
+
+  if (threads < 0)
+    throw runtime_error("The number of threads cannot be negative!");
+
+  /* "jobs" */
+  int32_t jobs = varsMap["jobs"].as<int32_t>();
+
+  if (jobs < 1)
+    throw runtime_error("The number of jobs must be positive!");
+
+  /* "memory" */
+  int32_t memory = varsMap["memory"].as<int32_t>();
+
+  if (memory < 0)
+    throw runtime_error("The memory cannot be negative!");
+
+  Parameters params;
+
+  params.engine.sParams  = sParams;
+  params.engine.nParams  = nParams;
+  params.engine.filter   = filterEngine;
+  params.engine.segments = segments;
+  params.engine.threads  = threads;
+  params.engine.aging    = aging;
+  params.engine.downscale = downscale;
+  params.engine.device   = device;
+  params.engine.format   = yuv ? "i420" : "bgr";
+  params.engine.tiles    = tiles;
+  params.engine.backing  = backing;
+  params.engine.stride   = stride;
+  params.visualization   = visualization;
+  params.buffers         = buffers;
+  params.stride          = stride;
+  params.convergence     = convergence;
+  params.patience        = patience;
+  params.emitFrames      = emitFrames;
+  params.emitSeconds     = emitSeconds;
+  params.checkpointFrames = checkpointFrames;
+  params.resume          = resume;
+  params.accuracy        = accuracy;
+  params.stats           = stats;
+  params.motionCache     = motionCache;
+  params.motionCacheLevel = motionCacheLevel;
+
+  /* Display parameters to the user. */
+  cout << (batchMode ? "         Batch: " : "Input sequence: ") << sequence << endl;
+  cout << "   Output path: "      << output        << endl;
+  cout << "             S: "      << sList.str()   << endl;
+  cout << "             N: "      << nList.str()   << endl;
+  cout << " Visualization: "      << visualization << endl;
+  cout << "       Buffers: "      << buffers       << endl;
+  cout << "        Filter: "      << filterEngine  << endl;
+
+  if (yuv)
+    cout << "          I420: "      << yuvWidth << "x" << yuvHeight << endl;
+  cout << "        Device: "      << device        << endl;
+  cout << "      Segments: "      << segments      << endl;
+  cout << "         Tiles: "      << tiles         << endl;
+
+  if (!backing.empty())
+    cout << "       Backing: "      << backing       << endl;
+
+  cout << "        Stride: "      << stride        << endl;
+  cout << "   Convergence: "      << convergence   << endl;
+  cout << "      Patience: "      << patience      << endl;
+  cout << "   Emit frames: "      << emitFrames    << endl;
+  cout << "  Emit seconds: "      << emitSeconds   << endl;
+  cout << "         Aging: "      << aging         << endl;
+  cout << "     Downscale: "      << downscale     << endl;
+  cout << "      Accuracy: "      << accuracy      << endl;
+  cout << "    Checkpoint: "      << checkpointFrames << endl;
+  cout << "        Resume: "      << resume        << endl;
+  cout << "        Shards: "      << shards        << endl;
+  cout << "         Stats: "      << stats         << endl;
+
+  if (!motionCache.empty())
+    cout << "  Motion cache: "      << motionCache   << " (level "
+         << motionCacheLevel << ")" << endl;
+
+  if (shard >= 0)
+    cout << "         Shard: "      << shard         << endl;
+
+  cout << "       Threads: "      << threads       << endl;
+
+  if (batchMode) {
+    cout << "          Jobs: "      << jobs          << endl;
+    cout << "        Memory: "      << memory        << endl;
+  }
+
+  cout << endl;
+
+  /* Initialization of the workers shared by all the stages and sequences. */
+  ThreadPool pool(threads);
+
+  /***************************************************************************
+   * Batch mode.                                                             *
+   ***************************************************************************/
+
+  if (batchMode) {
+    vector<BatchEntry> entries = getBatch(sequence);
+    cout << entries.size() << " sequences to process..." << endl;
+
+    size_t failures = processBatch(
+      params,
+      entries,
+      output,
+      jobs,
+      static_cast<size_t>(memory) << 20,
+      &pool
+    );
+
+    cout << (entries.size() - failures) << " sequences processed, "
+         << failures << " failed." << endl;
 
-    /* Insert the current frame and its probability map into the history. */
-    history->insert(quantitiesMotion, (*it));
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
+
+  /***************************************************************************
+   * Merging shards.                                                         *
+   ***************************************************************************/
 
-    if (visualization) {
-      history->median(background, sParam);
+  if (mergeMode) {
+    cv::Size size = LaBGenP::getCheckpointSize(getShardPath(output, 0));
+    LaBGenP engine(size.height, size.width, params.engine, &pool);
 
-      imshow("Estimated background", background);
-      cvWaitKey(1);
+    for (int32_t i = 0; i < shards; ++i) {
+      cout << "Merging " << getShardPath(output, i) << "..." << endl;
+
+      if (i == 0)
+        engine.load(getShardPath(output, i));
+      else {
+        LaBGenP later(size.height, size.width, params.engine, &pool);
+        later.load(getShardPath(output, i));
+
+        engine.merge(later);
+      }
     }
+
+    cout << endl;
+    writeBackgrounds(engine, output, cout);
+
+    return EXIT_SUCCESS;
   }
 
-  /* Compute background and write it. */
-  stringstream outputFile;
-  outputFile << output << "/output_" << sParam << "_" << nParam << ".png";
+  /***************************************************************************
+   * Opening sequence.                                                       *
+   ***************************************************************************/
+
+  VideoCapture decoder;
+  std::unique_ptr<FrameSource> source;
 
-  /* Compute background and write it. */
-  history->median(background, sParam);
+  if (yuv)
+    source.reset(new I420Source(sequence, yuvHeight, yuvWidth));
+  else {
+    decoder.open(sequence);
+
+    if (!decoder.isOpened())
+      throw runtime_error("Cannot open the '" + sequence + "' sequence.");
+
+    source.reset(new VideoSource(decoder));
+  }
 
-  cout << "Writing " << outputFile.str() << "..." << endl;
-  imwrite(outputFile.str(), background);
+  cout << "Reading sequence " << sequence << "..." << endl;
+
+  /***************************************************************************
+   * Processing.                                                             *
+   ***************************************************************************/
+
+  int32_t height = source->getHeight();
+  int32_t width  = source->getWidth();
+
+  LaBGenP engine(height, width, params.engine, &pool);
+
+  if (shard >= 0) {
+    source->release();
+    cout << "Processing shard " << shard << "..." << endl;
+
+    processShard(params, sequence, shard, shards, engine);
+
+    cout << "Writing " << getShardPath(output, shard) << "..." << endl;
+    engine.save(getShardPath(output, shard));
+  }
+  else if (shards > 1) {
+    source->release();
+    cout << "Processing " << shards << " shards..." << endl << endl;
+
+    processShards(params, sequence, shards, engine, &pool);
+    writeBackgrounds(engine, output, cout);
+  }
+  else if (visualization) {
+    /*
+     * The windows are handled by the main thread, as required by some
+     * systems, the sequence being processed by another one.
+     */
+    Preview preview;
+    std::exception_ptr error;
+
+    std::thread processing([&] {
+      try {
+        processSequence(params, sequence, *source, output, engine, cout, &preview);
+      }
+      catch (...) {
+        error = std::current_exception();
+      }
+
+      preview.finish();
+    });
+
+    preview.show();
+    processing.join();
+
+    if (error)
+      std::rethrow_exception(error);
+  }
+  else
+    processSequence(params, sequence, *source, output, engine, cout);
 
   /* Cleaning. */
   if (visualization) {
@@ -0,0 +1,1142 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include <opencv2/core/core.hpp>
+
+#include <labgen-p/FrameDifferenceC1L1.hpp>
+#include <labgen-p/History.hpp>
+#include <labgen-p/I420.hpp>
+#include <labgen-p/LaBGenP.hpp>
+#include <labgen-p/MotionCache.hpp>
+#include <labgen-p/MotionProba.hpp>
+#include <labgen-p/SummedAreaTables.hpp>
+#include <labgen-p/ThreadPool.hpp>
+#include <labgen-p/Utils.hpp>
+
+using namespace cv;
+using namespace std;
+using namespace boost::program_options;
+
+/******************************************************************************
+ * Synthetic sequences                                                        *
+ ******************************************************************************/
+
+/* Number of distinct frames of a synthetic sequence, pushed in a loop. */
+static const size_t RING_SIZE = 4;
+
+/******************************************************************************/
+
+/* Reproducible pseudo-random value of a pixel, whatever the platform. */
+static uint32_t getNoise(uint32_t x, uint32_t y, uint32_t seed) {
+  uint32_t h = x * 0x9E3779B1u ^ y * 0x85EBCA77u ^ seed * 0xC2B2AE3Du;
+
+  h ^= h >> 15;
+  h *= 0x2C1B3C6Du;
+  h ^= h >> 12;
+
+  return h;
+}
+
+/******************************************************************************/
+
+/*
+ * Frame of a synthetic sequence: a textured static background, a few
+ * rectangles moving across it, and some noise, so that every stage gets a
+ * realistic amount of motion.
+ */
+static Mat getSyntheticFrame(int32_t height, int32_t width, size_t num, uint32_t seed) {
+  Mat frame(height, width, CV_8UC3);
+
+  for (int32_t row = 0; row < height; ++row) {
+    uint8_t* pixel = frame.ptr<uint8_t>(row);
+
+    for (int32_t col = 0; col < width; ++col) {
+      uint32_t texture = getNoise(col / 8, row / 8, seed);
+      uint32_t noise = getNoise(col, row, seed + num + 1);
+
+      for (int32_t c = 0; c < CHANNELS; ++c)
+        *(pixel++) = ((texture >> (8 * c)) & 0xBF) + ((noise >> (8 * c)) & 0x0F);
+    }
+  }
+
+  for (uint32_t object = 0; object < 3; ++object) {
+    int32_t size = min(height, width) / (4 + object);
+    int32_t top = (getNoise(object, 0, seed) % height + num * (object + 1) * 3) % height;
+    int32_t left = (getNoise(object, 1, seed) % width + num * (object + 2) * 5) % width;
+
+    for (int32_t row = top; row < min(top + size, height); ++row) {
+      uint8_t* pixel = frame.ptr<uint8_t>(row) + left * CHANNELS;
+
+      for (int32_t col = left; col < min(left + size, width); ++col) {
+        for (int32_t c = 0; c < CHANNELS; ++c)
+          *(pixel++) = 64 * (object + 1) + 16 * c;
+      }
+    }
+  }
+
+  return frame;
+}
+
+/******************************************************************************/
+
+static vector<Mat> getSyntheticSequence(
+  int32_t height,
+  int32_t width,
+  size_t frames,
+  uint32_t seed
+) {
+  vector<Mat> sequence;
+
+  for (size_t num = 0; num < frames; ++num)
+    sequence.push_back(getSyntheticFrame(height, width, num, seed));
+
+  return sequence;
+}
+
+/******************************************************************************
+ * Measurements                                                               *
+ ******************************************************************************/
+
+/*
+ * Runs body(i) for i in [0, repetitions) after a first run warming up the
+ * caches and the allocations, and returns the mean time of a run in
+ * milliseconds.
+ */
+template <typename Body>
+static double measure(size_t repetitions, const Body& body) {
+  body(0);
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  for (size_t i = 0; i < repetitions; ++i)
+    body(i);
+
+  chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+
+  return elapsed.count() / repetitions;
+}
+
+/******************************************************************************/
+
+static void report(
+  const string& stage,
+  const string& parameters,
+  double milliseconds,
+  size_t pixels
+) {
+  cout << "  " << left << setw(38) << stage << setw(14) << parameters << right
+       << fixed << setprecision(3) << setw(10) << milliseconds << " ms"
+       << setprecision(1) << setw(10) << (pixels / milliseconds / 1000)
+       << " Mpx/s" << endl;
+}
+
+/******************************************************************************/
+
+static string getParameters(int32_t s, int32_t n) {
+  stringstream parameters;
+
+  if (s > 0)
+    parameters << "S=" << s << " ";
+
+  if (n > 0)
+    parameters << "N=" << n;
+
+  return parameters.str();
+}
+
+/******************************************************************************
+ * Microbenchmarks                                                            *
+ ******************************************************************************/
+
+static void benchmarkStages(
+  const vector<Mat>& sequence,
+  const vector<int32_t>& sParams,
+  const vector<int32_t>& nParams,
+  size_t repetitions,
+  ThreadPool* pool
+) {
+  int32_t height = sequence.front().rows;
+  int32_t width = sequence.front().cols;
+  size_t pixels = static_cast<size_t>(height) * width;
+
+  /* Frame difference, into a map of scores and into a summed area table. */
+  FrameDifferenceC1L1 fdiff(pool);
+  fdiff.allocate(height, width);
+
+  Mat scores(height, width, CV_8UC1);
+  SummedAreaTables<MotionProba::ProbaMapEncoding> sums;
+
+  report(
+    "FrameDifferenceC1L1::process",
+    "map",
+    measure(repetitions, [&](size_t i) {
+      fdiff.process(sequence[i % RING_SIZE], scores);
+    }),
+    pixels
+  );
+
+  report(
+    "FrameDifferenceC1L1::process",
+    "sums",
+    measure(repetitions, [&](size_t i) {
+      fdiff.process(sequence[i % RING_SIZE], sums);
+    }),
+    pixels
+  );
+
+  /* Summed area table of the scores, and box sums read from it. */
+  SummedAreaTables<MotionProba::ProbaMapEncoding> table;
+
+  report(
+    "SummedAreaTables::compute",
+    "",
+    measure(repetitions, [&](size_t) {
+      table.compute(scores);
+    }),
+    pixels
+  );
+
+  for (size_t n = 0; n < nParams.size(); ++n) {
+    int32_t half = min(height, width) / nParams[n] / 2;
+    volatile MotionProba::ProbaMapEncoding total = 0;
+
+    report(
+      "SummedAreaTables::getIntegral",
+      getParameters(0, nParams[n]),
+      measure(repetitions, [&](size_t) {
+        MotionProba::ProbaMapEncoding sum = 0;
+
+        for (int32_t row = 0; row < height; ++row) {
+          for (int32_t col = 0; col < width; ++col)
+            sum += table.getIntegral(row - half, row + half, col - half, col + half);
+        }
+
+        total = total + sum;
+      }),
+      pixels
+    );
+  }
+
+  /* Quantities of motion, and the histories for each value of S. */
+  for (size_t n = 0; n < nParams.size(); ++n) {
+    int32_t kernelSize = (min(height, width) / nParams[n]) | 1;
+
+    shared_ptr<MotionProba> counter = MotionProba::create("sat", kernelSize, pool);
+    shared_ptr<MotionProba> separable = MotionProba::create("separable", kernelSize, pool);
+
+    int encoding = counter->getOpenCVEncoding();
+    Mat quantities(height, width, encoding);
+
+    report(
+      "CounterMotionProba::compute",
+      getParameters(0, nParams[n]),
+      measure(repetitions, [&](size_t) {
+        counter->compute(scores, quantities);
+      }),
+      pixels
+    );
+
+    report(
+      "CounterMotionProba::computeFromSums",
+      getParameters(0, nParams[n]),
+      measure(repetitions, [&](size_t) {
+        counter->computeFromSums(sums, quantities);
+      }),
+      pixels
+    );
+
+    report(
+      "SeparableCounterMotionProba::compute",
+      getParameters(0, nParams[n]),
+      measure(repetitions, [&](size_t) {
+        separable->compute(scores, quantities);
+      }),
+      pixels
+    );
+
+    Utils::ROIs rois = Utils::getROIs(height, width, 0);
+
+    for (size_t i = 0; i < sParams.size(); ++i) {
+      shared_ptr<BasePatchesHistory> history =
+        BasePatchesHistory::create(rois, sParams[i], pool, encoding);
+
+      /* The histories are filled first, as in the steady state. */
+      for (int32_t j = 0; j < sParams[i]; ++j)
+        history->insert(quantities, sequence[j % RING_SIZE]);
+
+      report(
+        "PatchesHistory::insert",
+        getParameters(sParams[i], nParams[n]),
+        measure(repetitions, [&](size_t j) {
+          history->insert(quantities, sequence[j % RING_SIZE]);
+        }),
+        pixels
+      );
+
+      /*
+       * Static scene: the histories hold samples without any motion, which
+       * reject nearly all the new ones.
+       */
+      shared_ptr<BasePatchesHistory> still =
+        BasePatchesHistory::create(rois, sParams[i], pool, encoding);
+      Mat motionless(height, width, encoding, Scalar(0));
+
+      for (int32_t j = 0; j < sParams[i]; ++j)
+        still->insert(motionless, sequence[j % RING_SIZE]);
+
+      report(
+        "PatchesHistory::insert (rejected)",
+        getParameters(sParams[i], nParams[n]),
+        measure(repetitions, [&](size_t j) {
+          still->insert(quantities, sequence[j % RING_SIZE]);
+        }),
+        pixels
+      );
+
+      Mat background(height, width, CV_8UC3);
+
+      report(
+        "PatchesHistory::median",
+        getParameters(sParams[i], nParams[n]),
+        measure(repetitions, [&](size_t) {
+          history->median(background, sParams[i]);
+        }),
+        pixels
+      );
+
+      uint8_t* result = background.ptr<uint8_t>();
+
+      report(
+        "History::median",
+        getParameters(sParams[i], nParams[n]),
+        measure(repetitions, [&](size_t) {
+          for (size_t num = 0; num < pixels; ++num)
+            (*history).median(num, result + num * CHANNELS, sParams[i]);
+        }),
+        pixels
+      );
+    }
+  }
+}
+
+/******************************************************************************
+ * End-to-end benchmark                                                       *
+ ******************************************************************************/
+
+static void benchmarkEngine(
+  const vector<Mat>& sequence,
+  const vector<int32_t>& sParams,
+  const vector<int32_t>& nParams,
+  size_t frames,
+  ThreadPool* pool
+) {
+  int32_t height = sequence.front().rows;
+  int32_t width = sequence.front().cols;
+
+  LaBGenP::Parameters params;
+  params.sParams = sParams;
+  params.nParams = nParams;
+
+  /* The sat filter, the separable one, and the tiles. */
+  for (size_t f = 0; f < 3; ++f) {
+    params.filter = (f == 1) ? "separable" : "sat";
+    params.tiles = (f == 2) ? 4 : 0;
+
+    string name = params.tiles ? "4 tiles" : params.filter;
+
+    LaBGenP engine(height, width, params, pool);
+    Mat background;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    for (size_t num = 0; num < frames; ++num)
+      engine.pushFrame(sequence[num % RING_SIZE]);
+
+    for (size_t n = 0; n < nParams.size(); ++n) {
+      for (size_t i = 0; i < sParams.size(); ++i)
+        engine.getBackground(background, sParams[i], nParams[n]);
+    }
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    cout << "  " << left << setw(38) << ("LaBGenP (" + name + ")")
+         << right << fixed << setprecision(1) << setw(24)
+         << (frames / elapsed.count()) << " fps" << endl;
+  }
+}
+
+/******************************************************************************
+ * Bit-exactness                                                              *
+ ******************************************************************************/
+
+/*
+ * Frames of the check: the baseline program ignores the second frame of a
+ * sequence, which is thus removed for the backgrounds to be comparable with
+ * its outputs. The I420 frames take the luma of the BGR ones, and their
+ * chroma from the top-left pixel of each 2x2 block.
+ */
+static vector<Mat> getCheckSequence(int32_t height, int32_t width, bool i420) {
+  vector<Mat> sequence = getSyntheticSequence(height, width, 40, 1);
+  sequence.erase(sequence.begin() + 1);
+
+  for (size_t num = 0; i420 && num < sequence.size(); ++num) {
+    Mat frame(height * 3 / 2, width, CV_8UC1);
+    uint8_t* uPlane = frame.ptr<uint8_t>(height);
+    uint8_t* vPlane = uPlane + (height / 2) * (width / 2);
+
+    for (int32_t row = 0; row < height; ++row) {
+      const uint8_t* bgr = sequence[num].ptr<uint8_t>(row);
+      uint8_t* y = frame.ptr<uint8_t>(row);
+
+      for (int32_t col = 0; col < width; ++col, bgr += CHANNELS) {
+        y[col] = (bgr[0] * 1868 + bgr[1] * 9617 + bgr[2] * 4899 + (1 << 13)) >> 14;
+
+        if ((row & 1) == 0 && (col & 1) == 0) {
+          uPlane[(row / 2) * (width / 2) + col / 2] = bgr[1];
+          vPlane[(row / 2) * (width / 2) + col / 2] = bgr[2];
+        }
+      }
+    }
+
+    sequence[num] = frame;
+  }
+
+  return sequence;
+}
+
+/******************************************************************************/
+
+/*
+ * Straightforward implementation of LaBGen-P, following the method rather
+ * than the optimizations of the library: sorted histories per ROI, quantities
+ * of motion summed over the cropped kernels, and a ROI scored by the floor of
+ * their mean over its pixels. Only the S and N parameters, the segments, the
+ * aging, and the format of the parameters are used. The medians of I420
+ * frames are computed on the Y, U and V values, then converted by I420.
+ */
+static vector<Mat> getReferenceBackgrounds(
+  const vector<Mat>& sequence,
+  const LaBGenP::Parameters& params
+) {
+  const vector<int32_t>& sParams = params.sParams;
+  const vector<int32_t>& nParams = params.nParams;
+
+  bool yuv = (params.format == "i420");
+  int32_t height = yuv ? I420::getHeight(sequence.front().rows) : sequence.front().rows;
+  int32_t width = sequence.front().cols;
+  size_t pixels = static_cast<size_t>(height) * width;
+  size_t bufferSize = sParams.back();
+
+  Utils::ROIs rois = Utils::getROIs(height, width, params.segments);
+
+  /* The colors of the pixels of the ROI, row by row. */
+  struct Sample {
+    int64_t positives;
+    vector<uint8_t> colors;
+  };
+
+  vector<vector<vector<Sample> > > histories(
+    nParams.size(),
+    vector<vector<Sample> >(rois.size())
+  );
+
+  vector<int32_t> previous;
+
+  for (size_t num = 0; num < sequence.size(); ++num) {
+    vector<int32_t> luma(pixels);
+    vector<uint8_t> colors(pixels * CHANNELS);
+
+    for (int32_t row = 0; row < height; ++row) {
+      const uint8_t* frame = sequence[num].ptr<uint8_t>(row);
+      const uint8_t* uPlane = sequence[num].ptr<uint8_t>(height);
+      const uint8_t* vPlane = uPlane + (height / 2) * (width / 2);
+
+      for (int32_t col = 0; col < width; ++col) {
+        size_t p = static_cast<size_t>(row) * width + col;
+        uint8_t* color = &colors[p * CHANNELS];
+
+        if (yuv) {
+          color[0] = frame[col];
+          color[1] = uPlane[(row / 2) * (width / 2) + col / 2];
+          color[2] = vPlane[(row / 2) * (width / 2) + col / 2];
+
+          luma[p] = color[0];
+        }
+        else {
+          const uint8_t* bgr = frame + col * CHANNELS;
+          copy(bgr, bgr + CHANNELS, color);
+
+          luma[p] = (bgr[0] * 1868 + bgr[1] * 9617 + bgr[2] * 4899 + (1 << 13)) >> 14;
+        }
+      }
+    }
+
+    if (num == 0) {
+      previous.swap(luma);
+      continue;
+    }
+
+    vector<int32_t> scores(pixels);
+
+    for (size_t p = 0; p < pixels; ++p)
+      scores[p] = abs(luma[p] - previous[p]);
+
+    previous.swap(luma);
+
+    for (size_t n = 0; n < nParams.size(); ++n) {
+      int32_t half = ((min(height, width) / nParams[n]) | 1) / 2;
+
+      /* Sums over the cropped columns of the kernels, then along the rows. */
+      vector<int64_t> columns(pixels);
+      vector<int64_t> quantities(pixels);
+
+      for (int32_t row = 0; row < height; ++row) {
+        for (int32_t col = 0; col < width; ++col) {
+          for (int32_t y = max(row - half, 0); y <= min(row + half, height - 1); ++y)
+            columns[row * width + col] += scores[y * width + col];
+        }
+      }
+
+      for (int32_t row = 0; row < height; ++row) {
+        for (int32_t col = 0; col < width; ++col) {
+          for (int32_t x = max(col - half, 0); x <= min(col + half, width - 1); ++x)
+            quantities[row * width + col] += columns[row * width + x];
+        }
+      }
+
+      for (size_t num = 0; num < rois.size(); ++num) {
+        Rect rect = rois[num];
+
+        if (rect.area() == 0)
+          continue;
+
+        Sample sample;
+        sample.positives = 0;
+
+        for (int32_t y = rect.y; y < rect.y + rect.height; ++y) {
+          for (int32_t x = rect.x; x < rect.x + rect.width; ++x) {
+            size_t p = static_cast<size_t>(y) * width + x;
+
+            sample.positives += quantities[p];
+            sample.colors.insert(
+              sample.colors.end(),
+              colors.begin() + p * CHANNELS,
+              colors.begin() + (p + 1) * CHANNELS
+            );
+          }
+        }
+
+        sample.positives /= rect.area();
+
+        /* Before the first sample having at least as many positives. */
+        vector<Sample>& history = histories[n][num];
+
+        size_t pos = 0;
+
+        while (pos < history.size() && history[pos].positives < sample.positives)
+          ++pos;
+
+        if (pos == bufferSize)
+          continue;
+
+        history.insert(history.begin() + pos, sample);
+
+        if (history.size() > bufferSize)
+          history.pop_back();
+      }
+
+      /* The keys of the aging are saturated just below the largest int32_t. */
+      for (size_t num = 0; params.aging > 0 && num < rois.size(); ++num) {
+        for (size_t j = 0; j < histories[n][num].size(); ++j) {
+          int64_t& positives = histories[n][num][j].positives;
+          positives = min<int64_t>(positives + params.aging, INT32_MAX - 1);
+        }
+      }
+    }
+  }
+
+  /* One background per (S, N) pair, N major. */
+  vector<Mat> backgrounds;
+
+  for (size_t n = 0; n < nParams.size(); ++n) {
+    for (size_t i = 0; i < sParams.size(); ++i) {
+      Mat background(height, width, CV_8UC3);
+
+      for (size_t num = 0; num < rois.size(); ++num) {
+        Rect rect = rois[num];
+        const vector<Sample>& history = histories[n][num];
+        size_t size = min(history.size(), static_cast<size_t>(sParams[i]));
+
+        for (int32_t y = rect.y, k = 0; y < rect.y + rect.height; ++y) {
+          for (int32_t x = rect.x; x < rect.x + rect.width; ++x, ++k) {
+            uint8_t* result = background.ptr<uint8_t>(y) + x * CHANNELS;
+
+            for (int32_t c = 0; c < CHANNELS; ++c) {
+              vector<uint8_t> values;
+
+              for (size_t j = 0; j < size; ++j)
+                values.push_back(history[j].colors[k * CHANNELS + c]);
+
+              sort(values.begin(), values.end());
+
+              result[c] = (size % 2) ?
+                values[size / 2] :
+                (values[size / 2 - 1] + values[size / 2]) / 2;
+            }
+          }
+        }
+      }
+
+      if (yuv)
+        I420::toBGR(background, background);
+
+      backgrounds.push_back(background);
+    }
+  }
+
+  return backgrounds;
+}
+
+/******************************************************************************/
+
+/*
+ * Backgrounds of the baseline program on the BGR check sequence, at pixel
+ * level, which it only supported, as FNV-1a checksums.
+ */
+struct BaselineOutput {
+  int32_t s;
+  int32_t n;
+  uint64_t checksum;
+};
+
+static const BaselineOutput BASELINE_OUTPUTS[] = {
+  { 5, 1, 0x9c0b93a4c8f24f95ULL},
+  {19, 1, 0x7cf24d53d042a7e5ULL},
+  { 5, 3, 0xafbef4bfaec4319bULL},
+  {19, 3, 0x0cfe20dfad218bc1ULL},
+  { 5, 5, 0x068938859cc749b6ULL},
+  {19, 5, 0x1c0225395f378addULL}
+};
+
+/******************************************************************************/
+
+static uint64_t getChecksum(const Mat& background) {
+  const uint8_t* data = background.ptr<uint8_t>();
+  uint64_t checksum = 14695981039346656037ULL;
+
+  for (size_t i = 0; i < background.total() * background.elemSize(); ++i) {
+    checksum ^= data[i];
+    checksum *= 1099511628211ULL;
+  }
+
+  return checksum;
+}
+
+/******************************************************************************/
+
+/*
+ * Backgrounds of an engine having processed the sequence, split into shards
+ * overlapping by one frame and merged when shards > 1. When checkpoint > 0,
+ * the engine is saved after that many frames into the current folder, and
+ * replaced by a new engine loading the checkpoint, removed afterwards, which
+ * processes the remaining frames. One background per (S, N) pair, N major.
+ */
+static vector<Mat> getBackgrounds(
+  const vector<Mat>& sequence,
+  const LaBGenP::Parameters& params,
+  size_t shards,
+  size_t checkpoint,
+  ThreadPool* pool
+) {
+  int32_t height = sequence.front().rows;
+  int32_t width = sequence.front().cols;
+
+  if (params.format == "i420")
+    height = I420::getHeight(height);
+
+  vector<std::unique_ptr<LaBGenP> > engines;
+
+  for (size_t shard = 0; shard < shards; ++shard) {
+    size_t begin = shard * (sequence.size() - 1) / shards;
+    size_t end = (shard + 1) * (sequence.size() - 1) / shards + 1;
+
+    engines.push_back(std::unique_ptr<LaBGenP>(new LaBGenP(height, width, params, pool)));
+
+    for (size_t num = begin; num < end; ++num) {
+      if (num == checkpoint) {
+        string path = "LaBGen-P_bench.lgp";
+        engines.back()->save(path);
+
+        engines.back().reset(new LaBGenP(height, width, params, pool));
+        engines.back()->load(path);
+
+        std::remove(path.c_str());
+      }
+
+      engines.back()->pushFrame(sequence[num]);
+    }
+
+    if (shard > 0)
+      engines.front()->merge(*(engines.back()));
+  }
+
+  vector<Mat> backgrounds;
+
+  for (size_t n = 0; n < params.nParams.size(); ++n) {
+    for (size_t i = 0; i < params.sParams.size(); ++i) {
+      backgrounds.push_back(Mat());
+      engines.front()->getBackground(backgrounds.back(), params.sParams[i], params.nParams[n]);
+    }
+  }
+
+  return backgrounds;
+}
+
+/******************************************************************************/
+
+/*
+ * Backgrounds of an engine replaying the quantities of motion of the sequence
+ * recorded by another engine into motion caches of the given level, written
+ * into the current folder and removed afterwards. One background per (S, N)
+ * pair, N major.
+ */
+static vector<Mat> getReplayedBackgrounds(
+  const vector<Mat>& sequence,
+  const LaBGenP::Parameters& params,
+  int level,
+  ThreadPool* pool
+) {
+  int32_t height = sequence.front().rows;
+  int32_t width = sequence.front().cols;
+
+  if (params.format == "i420")
+    height = I420::getHeight(height);
+
+  vector<string> paths;
+
+  for (size_t n = 0; n < params.nParams.size(); ++n) {
+    stringstream path;
+    path << "LaBGen-P_bench_" << params.nParams[n] << ".cache";
+    paths.push_back(path.str());
+  }
+
+  /* Recording, the first frame having no quantities of motion. */
+  LaBGenP recorder(height, width, params, pool);
+  vector<std::unique_ptr<MotionCacheWriter> > writers;
+
+  for (size_t n = 0; n < paths.size(); ++n) {
+    const Mat& quantities = recorder.getReducedQuantitiesOfMotion()[n];
+
+    writers.push_back(std::unique_ptr<MotionCacheWriter>(new MotionCacheWriter(
+      paths[n], "check", quantities.size(), quantities.type(), level
+    )));
+  }
+
+  for (size_t num = 0; num < sequence.size(); ++num) {
+    recorder.pushFrame(sequence[num]);
+
+    for (size_t n = 0; num > 0 && n < writers.size(); ++n)
+      writers[n]->write(recorder.getReducedQuantitiesOfMotion()[n]);
+  }
+
+  for (size_t n = 0; n < writers.size(); ++n)
+    writers[n]->close();
+
+  /* Replay. */
+  LaBGenP engine(height, width, params, pool);
+  vector<std::unique_ptr<MotionCache> > caches;
+  vector<Mat> quantities(paths.size());
+
+  for (size_t n = 0; n < paths.size(); ++n)
+    caches.push_back(std::unique_ptr<MotionCache>(new MotionCache(paths[n])));
+
+  engine.pushFrame(sequence.front());
+
+  for (size_t num = 1; num < sequence.size(); ++num) {
+    for (size_t n = 0; n < caches.size(); ++n)
+      quantities[n] = caches[n]->getQuantities(num - 1);
+
+    engine.pushFrame(sequence[num], quantities);
+  }
+
+  caches.clear();
+
+  for (size_t n = 0; n < paths.size(); ++n)
+    std::remove(paths[n].c_str());
+
+  vector<Mat> backgrounds;
+
+  for (size_t n = 0; n < params.nParams.size(); ++n) {
+    for (size_t i = 0; i < params.sParams.size(); ++i) {
+      backgrounds.push_back(Mat());
+      engine.getBackground(backgrounds.back(), params.sParams[i], params.nParams[n]);
+    }
+  }
+
+  return backgrounds;
+}
+
+/******************************************************************************/
+
+/*
+ * A configuration of the engine, processing the sequence with a pool of its
+ * own when threads > 0, in shards when shards > 1, replaying motion caches of
+ * the given level when cache >= 0, and resuming from a checkpoint saved after
+ * the given number of frames when checkpoint > 0.
+ */
+struct Configuration {
+  string name;
+  LaBGenP::Parameters params;
+  size_t threads;
+  size_t shards;
+  int cache;
+  size_t checkpoint;
+};
+
+/******************************************************************************/
+
+/*
+ * Compares the backgrounds of the engine, in several configurations, with the
+ * ones of the reference implementation, and the ones of the pixel level with
+ * the outputs of the baseline program, on small synthetic sequences. Prints
+ * one line per configuration, and returns the number of configurations that
+ * differ.
+ */
+static size_t checkExactness(
+  const vector<int32_t>& sParams,
+  const vector<int32_t>& nParams,
+  ThreadPool* pool
+) {
+  vector<Mat> bgrSequence = getCheckSequence(61, 97, false);
+  vector<Mat> i420Sequence = getCheckSequence(60, 96, true);
+
+  LaBGenP::Parameters params;
+  params.sParams = sParams;
+  params.nParams = nParams;
+
+  vector<Configuration> configurations;
+
+  auto add = [&](
+    const string& name,
+    const LaBGenP::Parameters& params,
+    size_t threads,
+    size_t shards,
+    int cache,
+    size_t checkpoint
+  ) {
+    Configuration configuration = {name, params, threads, shards, cache, checkpoint};
+    configurations.push_back(configuration);
+  };
+
+  for (size_t f = 0; f < 2; ++f) {
+    LaBGenP::Parameters filtered = params;
+    filtered.filter = f ? "separable" : "sat";
+
+    add(filtered.filter, filtered, 0, 1, -1, 0);
+    add(filtered.filter + ", 4 threads", filtered, 4, 1, -1, 0);
+  }
+
+  LaBGenP::Parameters variant = params;
+  variant.tiles = 4;
+  add("tiles", variant, 0, 1, -1, 0);
+  add("tiles, 4 threads", variant, 4, 1, -1, 0);
+
+  for (int32_t segments = 4; segments <= 9; segments += 5) {
+    variant = params;
+    variant.segments = segments;
+    add("segments " + to_string(segments), variant, 0, 1, -1, 0);
+  }
+
+  variant = params;
+  variant.aging = 50;
+  add("aging", variant, 0, 1, -1, 0);
+  variant.tiles = 4;
+  add("aging, tiles", variant, 4, 1, -1, 0);
+
+  variant = params;
+  variant.format = "i420";
+  add("i420", variant, 0, 1, -1, 0);
+  variant.tiles = 4;
+  add("i420, tiles", variant, 4, 1, -1, 0);
+
+  add("3 shards", params, 0, 3, -1, 0);
+
+  /*
+   * Motion caches, uncompressed and compressed, of 16 bits maps for N = 5 and
+   * of 32 bits ones for N = 1 and with the aging.
+   */
+  for (int32_t level = 0; level <= 1; ++level) {
+    variant = params;
+    variant.nParams = {1, 5};
+    add("cache level " + to_string(level), variant, 0, 1, level, 0);
+
+    variant.aging = 50;
+    add("cache level " + to_string(level) + ", aging", variant, 0, 1, level, 0);
+  }
+
+  /* Checkpoints saved in the middle of the sequence, with the aging and in YUV. */
+  add("checkpoint", params, 0, 1, -1, 20);
+
+  variant = params;
+  variant.aging = 50;
+  add("checkpoint, aging", variant, 0, 1, -1, 20);
+
+  variant = params;
+  variant.format = "i420";
+  add("checkpoint, i420", variant, 0, 1, -1, 20);
+
+  map<string, vector<Mat> > references;
+  size_t mismatches = 0;
+
+  for (size_t j = 0; j < configurations.size(); ++j) {
+    const Configuration& configuration = configurations[j];
+    const vector<Mat>& sequence =
+      (configuration.params.format == "i420") ? i420Sequence : bgrSequence;
+
+    std::unique_ptr<ThreadPool> ownPool;
+
+    if (configuration.threads > 0)
+      ownPool.reset(new ThreadPool(configuration.threads));
+
+    ThreadPool* configurationPool = (configuration.threads > 0) ? ownPool.get() : pool;
+
+    vector<Mat> backgrounds = (configuration.cache >= 0) ?
+      getReplayedBackgrounds(
+        sequence,
+        configuration.params,
+        configuration.cache,
+        configurationPool
+      ) :
+      getBackgrounds(
+        sequence,
+        configuration.params,
+        configuration.shards,
+        configuration.checkpoint,
+        configurationPool
+      );
+
+    /* The configurations sharing the options of the reference share its backgrounds. */
+    stringstream key;
+    key << configuration.params.segments << " " << configuration.params.aging << " "
+        << configuration.params.format;
+
+    for (size_t n = 0; n < configuration.params.nParams.size(); ++n)
+      key << " " << configuration.params.nParams[n];
+
+    if (references.find(key.str()) == references.end())
+      references[key.str()] = getReferenceBackgrounds(sequence, configuration.params);
+
+    const vector<Mat>& expected = references[key.str()];
+    size_t different = 0;
+
+    for (size_t k = 0; k < backgrounds.size(); ++k) {
+      size_t bytes = expected[k].total() * expected[k].elemSize();
+
+      different +=
+        memcmp(backgrounds[k].ptr<uint8_t>(), expected[k].ptr<uint8_t>(), bytes) != 0;
+    }
+
+    cout << "  " << left << setw(38) << ("LaBGenP (" + configuration.name + ")")
+         << setw(14) << (to_string(backgrounds.size() - different) + "/" +
+                         to_string(backgrounds.size()))
+         << (different ? "DIFFERENT" : "identical") << right << endl;
+
+    mismatches += (different > 0);
+  }
+
+  /* The baseline program used the sat filter and no thread. */
+  LaBGenP::Parameters baseline;
+  baseline.sParams = {5, 19};
+  baseline.nParams = {1, 3, 5};
+
+  vector<Mat> backgrounds = getBackgrounds(bgrSequence, baseline, 1, 0, NULL);
+  size_t outputs = sizeof(BASELINE_OUTPUTS) / sizeof(BASELINE_OUTPUTS[0]);
+  size_t different = 0;
+
+  for (size_t k = 0; k < outputs; ++k) {
+    const BaselineOutput& output = BASELINE_OUTPUTS[k];
+
+    size_t i = find(baseline.sParams.begin(), baseline.sParams.end(), output.s) -
+      baseline.sParams.begin();
+    size_t n = find(baseline.nParams.begin(), baseline.nParams.end(), output.n) -
+      baseline.nParams.begin();
+
+    different += (getChecksum(backgrounds[n * baseline.sParams.size() + i]) != output.checksum);
+  }
+
+  cout << "  " << left << setw(38) << "LaBGenP (baseline outputs)"
+       << setw(14) << (to_string(outputs - different) + "/" + to_string(outputs))
+       << (different ? "DIFFERENT" : "identical") << right << endl;
+
+  mismatches += (different > 0);
+
+  return mismatches;
+}
+
+/******************************************************************************
+ * Main program                                                               *
+ ******************************************************************************/
+
+int main(int argc, char** argv) {
+  options_description optDesc(
+    string("LaBGen-P benchmarks - Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016\n") +
+    "http://www.montefiore.ulg.ac.be/~blaugraud\n"                                               +
+    "http://www.telecom.ulg.ac.be/labgen\n\n"                                                    +
+    "Usage: LaBGen-P_bench [options]"
+  );
+
+  optDesc.add_options()
+    (
+      "help,h",
+      "print this help message"
+    )
+    (
+      "sizes",
+      value<vector<string> >()->multitoken(),
+      "frame sizes among 480p, 1080p and 4k (all of them by default)"
+    )
+    (
+      "s-parameter,s",
+      value<vector<int32_t> >()->multitoken(),
+      "value(s) of the S parameter (5 19 40 by default)"
+    )
+    (
+      "n-parameter,n",
+      value<vector<int32_t> >()->multitoken(),
+      "value(s) of the N parameter (1 3 5 by default)"
+    )
+    (
+      "repetitions,r",
+      value<int32_t>()->default_value(10),
+      "number of runs of each stage"
+    )
+    (
+      "frames",
+      value<int32_t>()->default_value(100),
+      "number of frames of the end-to-end benchmark"
+    )
+    (
+      "threads,t",
+      value<int32_t>()->default_value(1),
+      "number of processing threads (0 for all the cores)"
+    )
+    (
+      "check-only",
+      "only check the bit-exactness of the engine"
+    )
+  ;
+
+  variables_map varsMap;
+  store(parse_command_line(argc, argv, optDesc), varsMap);
+  notify(varsMap);
+
+  if (varsMap.count("help")) {
+    cout << optDesc << endl;
+    return EXIT_SUCCESS;
+  }
+
+  vector<string> sizes = varsMap.count("sizes") ?
+    varsMap["sizes"].as<vector<string> >() :
+    vector<string>({"480p", "1080p", "4k"});
+
+  vector<int32_t> sParams = varsMap.count("s-parameter") ?
+    varsMap["s-parameter"].as<vector<int32_t> >() :
+    vector<int32_t>({5, 19, 40});
+
+  vector<int32_t> nParams = varsMap.count("n-parameter") ?
+    varsMap["n-parameter"].as<vector<int32_t> >() :
+    vector<int32_t>({1, 3, 5});
+
+  sort(sParams.begin(), sParams.end());
+  sParams.erase(unique(sParams.begin(), sParams.end()), sParams.end());
+
+  sort(nParams.begin(), nParams.end());
+  nParams.erase(unique(nParams.begin(), nParams.end()), nParams.end());
+
+  if (sParams.front() < 1 || nParams.front() < 1)
+    throw runtime_error("The S and N parameters must be positive!");
+
+  int32_t repetitions = varsMap["repetitions"].as<int32_t>();
+  int32_t frames = varsMap["frames"].as<int32_t>();
+  int32_t threads = varsMap["threads"].as<int32_t>();
+
+  if (repetitions < 1 || frames < 1)
+    throw runtime_error("The repetitions and frames must be positive!");
+
+  if (threads < 0)
+    throw runtime_error("The number of threads cannot be negative!");
+
+  ThreadPool pool(threads);
+  cout << "Threads: " << pool.size() << endl << endl;
+
+  /* Bit-exactness against the reference implementation. */
+  cout << "Bit-exactness (97x61 and 96x60, 39 frames):" << endl;
+  size_t mismatches = checkExactness(sParams, nParams, &pool);
+  cout << endl;
+
+  if (varsMap.count("check-only"))
+    return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+
+  for (size_t i = 0; i < sizes.size(); ++i) {
+    int32_t height;
+    int32_t width;
+
+    if (sizes[i] == "480p") {
+      height = 480;
+      width = 854;
+    }
+    else if (sizes[i] == "1080p") {
+      height = 1080;
+      width = 1920;
+    }
+    else if (sizes[i] == "4k") {
+      height = 2160;
+      width = 3840;
+    }
+    else
+      throw runtime_error("Unknown frame size '" + sizes[i] + "'!");
+
+    cout << sizes[i] << " (" << width << "x" << height << "):" << endl;
+
+    vector<Mat> sequence = getSyntheticSequence(height, width, RING_SIZE, 0);
+
+    benchmarkStages(sequence, sParams, nParams, repetitions, &pool);
+    benchmarkEngine(sequence, sParams, nParams, frames, &pool);
+
+    cout << endl;
+  }
+
+  return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
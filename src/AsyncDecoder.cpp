@@ -0,0 +1,183 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdexcept>
+
+#include <labgen-p/AsyncDecoder.hpp>
+
+/* ========================================================================== *
+ * AsyncDecoder                                                               *
+ * ========================================================================== */
+
+AsyncDecoder::AsyncDecoder(
+  FrameSource& source,
+  size_t capacity,
+  size_t stride
+) :
+source(source),
+buffers(),
+stride(stride),
+head(0),
+tail(0),
+count(0),
+finished(false),
+stopped(false),
+decodeTime(0),
+waitTime(0) {
+  if (capacity == 0)
+    throw std::logic_error("The capacity of the frames ring must be positive");
+
+  if (stride == 0)
+    throw std::logic_error("The stride must be positive");
+
+  buffers.reserve(capacity);
+
+  for (size_t i = 0; i < capacity; ++i)
+    buffers.push_back(source.allocate());
+}
+
+/******************************************************************************/
+
+AsyncDecoder::~AsyncDecoder() {
+  stop();
+}
+
+/******************************************************************************/
+
+void AsyncDecoder::start() {
+  thread = std::thread(&AsyncDecoder::run, this);
+}
+
+/******************************************************************************/
+
+void AsyncDecoder::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopped = true;
+  }
+
+  notFull.notify_all();
+
+  if (thread.joinable())
+    thread.join();
+}
+
+/******************************************************************************/
+
+const cv::Mat* AsyncDecoder::acquire() {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  std::unique_lock<std::mutex> lock(mutex);
+  notEmpty.wait(lock, [this] { return count > 0 || finished; });
+
+  waitTime += std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start
+  ).count();
+
+  if (count == 0) {
+    if (error)
+      std::rethrow_exception(error);
+
+    return NULL;
+  }
+
+  return &(buffers[tail]);
+}
+
+/******************************************************************************/
+
+void AsyncDecoder::release() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    tail = (tail + 1) % buffers.size();
+    --count;
+  }
+
+  notFull.notify_one();
+}
+
+/******************************************************************************/
+
+void AsyncDecoder::run() {
+  try {
+    for (;;) {
+      size_t slot;
+
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] { return count < buffers.size() || stopped; });
+
+        if (stopped)
+          break;
+
+        slot = head;
+      }
+
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+      /* The slot is not visible to the consumer until it is committed. */
+      bool decoded = source.read(buffers[slot]);
+
+      decodeTime += std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start
+      ).count();
+
+      if (!decoded)
+        break;
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        head = (head + 1) % buffers.size();
+        ++count;
+      }
+
+      notEmpty.notify_one();
+
+      /*
+       * Skipped frames are only grabbed: a video still decodes them, but they
+       * are neither retrieved nor copied into a buffer.
+       */
+      bool exhausted = false;
+
+      start = std::chrono::steady_clock::now();
+
+      for (size_t i = 1; i < stride && !exhausted; ++i)
+        exhausted = !source.grab();
+
+      decodeTime += std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start
+      ).count();
+
+      if (exhausted)
+        break;
+    }
+  }
+  catch (...) {
+    std::lock_guard<std::mutex> lock(mutex);
+    error = std::current_exception();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    finished = true;
+  }
+
+  notEmpty.notify_all();
+}
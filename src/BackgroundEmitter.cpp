@@ -0,0 +1,129 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <labgen-p/BackgroundEmitter.hpp>
+
+/* ========================================================================== *
+ * BackgroundEmitter                                                          *
+ * ========================================================================== */
+
+BackgroundEmitter::BackgroundEmitter(Callback callback) :
+callback(callback),
+pending(),
+current(),
+pendingFrame(0),
+hasPending(false),
+dropped(0),
+stopped(false) {}
+
+/******************************************************************************/
+
+BackgroundEmitter::~BackgroundEmitter() {
+  try {
+    stop();
+  }
+  catch (...) {}
+}
+
+/******************************************************************************/
+
+void BackgroundEmitter::start() {
+  stopped = false;
+  thread = std::thread(&BackgroundEmitter::run, this);
+}
+
+/******************************************************************************/
+
+void BackgroundEmitter::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopped = true;
+  }
+
+  wakeUp.notify_one();
+
+  if (thread.joinable())
+    thread.join();
+
+  if (error) {
+    std::exception_ptr rethrown = error;
+    error = std::exception_ptr();
+
+    std::rethrow_exception(rethrown);
+  }
+}
+
+/******************************************************************************/
+
+void BackgroundEmitter::emit(const cv::Mat& background, size_t frame) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    /* Once the callback has failed, the snapshots are discarded. */
+    if (error)
+      return;
+
+    if (hasPending)
+      ++dropped;
+
+    /* The buffer is reallocated only if the size changes. */
+    background.copyTo(pending);
+    pendingFrame = frame;
+    hasPending = true;
+  }
+
+  wakeUp.notify_one();
+}
+
+/******************************************************************************/
+
+size_t BackgroundEmitter::getDropped() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return dropped;
+}
+
+/******************************************************************************/
+
+void BackgroundEmitter::run() {
+  for (;;) {
+    size_t frame;
+
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wakeUp.wait(lock, [this] { return hasPending || stopped; });
+
+      if (!hasPending)
+        break;
+
+      /* The callback reads its own buffer while the next one is filled. */
+      std::swap(pending, current);
+      frame = pendingFrame;
+      hasPending = false;
+    }
+
+    try {
+      callback(current, frame);
+    }
+    catch (...) {
+      std::lock_guard<std::mutex> lock(mutex);
+      error = std::current_exception();
+
+      break;
+    }
+  }
+}
@@ -0,0 +1,146 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+#include <labgen-p/Decimation.hpp>
+
+/* ========================================================================== *
+ * Decimation                                                                 *
+ * ========================================================================== */
+
+/*
+ * The rows of each row of blocks are first summed into sums, holding
+ * decimated.cols x Channels values, so that the frame is read row by row.
+ */
+template <int Channels>
+static void decimateRows(
+  const cv::Mat& frame,
+  cv::Mat& decimated,
+  int factor,
+  int minOutputRow,
+  int maxOutputRow,
+  uint32_t* sums
+) {
+  int rows = frame.rows;
+  int cols = frame.cols;
+
+  for (int row = minOutputRow; row < maxOutputRow; ++row) {
+    int minRow = row * factor;
+    int maxRow = std::min(minRow + factor, rows);
+
+    std::fill(sums, sums + decimated.cols * Channels, 0);
+
+    for (int y = minRow; y < maxRow; ++y) {
+      const uint8_t* input = frame.ptr<uint8_t>(y);
+      uint32_t* sum = sums;
+
+      for (int x = 0; x < cols; sum += Channels) {
+        for (int xEnd = std::min(x + factor, cols); x < xEnd; ++x, input += Channels) {
+          for (int c = 0; c < Channels; ++c)
+            sum[c] += input[c];
+        }
+      }
+    }
+
+    uint8_t* output = decimated.ptr<uint8_t>(row);
+
+    for (int col = 0; col < decimated.cols; ++col) {
+      int minCol = col * factor;
+      uint32_t area = (maxRow - minRow) * (std::min(minCol + factor, cols) - minCol);
+
+      for (int c = 0; c < Channels; ++c) {
+        output[col * Channels + c] = static_cast<uint8_t>(
+          (sums[col * Channels + c] + area / 2) / area
+        );
+      }
+    }
+  }
+}
+
+/******************************************************************************/
+
+void Decimation::decimate(
+  const cv::Mat& frame,
+  cv::Mat& decimated,
+  int factor,
+  ThreadPool* pool
+) {
+  int channels = frame.channels();
+
+  if (frame.depth() != CV_8U || (channels != 1 && channels != 3))
+    throw std::logic_error("Only CV_8UC1 and CV_8UC3 frames can be decimated");
+
+  size_t rows = decimated.rows;
+  size_t width = static_cast<size_t>(decimated.cols) * channels;
+
+  rowSums.resize(ThreadPool::getBands(pool, rows) * width);
+
+  ThreadPool::runBands(pool, 0, rows, [&](size_t band, size_t begin, size_t end) {
+    uint32_t* sums = rowSums.data() + band * width;
+
+    if (channels == 1)
+      decimateRows<1>(frame, decimated, factor, begin, end, sums);
+    else
+      decimateRows<3>(frame, decimated, factor, begin, end, sums);
+  });
+}
+
+/******************************************************************************/
+
+template <typename T>
+static void replicateRows(
+  const cv::Mat& decimated,
+  cv::Mat& output,
+  int factor,
+  int minRow,
+  int maxRow
+) {
+  for (int y = minRow; y < maxRow; ++y) {
+    const T* input = decimated.ptr<T>(y / factor);
+    T* row = output.ptr<T>(y);
+
+    for (int x = 0; x < output.cols; ++input) {
+      for (int xEnd = std::min(x + factor, output.cols); x < xEnd; ++x)
+        row[x] = *input;
+    }
+  }
+}
+
+/******************************************************************************/
+
+void Decimation::replicate(
+  const cv::Mat& decimated,
+  cv::Mat& output,
+  int factor,
+  ThreadPool* pool
+) {
+  int depth = decimated.depth();
+
+  if (depth != CV_16U && depth != CV_32S)
+    throw std::logic_error("Only CV_16UC1 and CV_32SC1 matrices can be replicated");
+
+  ThreadPool::run(pool, 0, output.rows, [&](size_t begin, size_t end) {
+    if (depth == CV_16U)
+      replicateRows<uint16_t>(decimated, output, factor, begin, end);
+    else
+      replicateRows<int32_t>(decimated, output, factor, begin, end);
+  });
+}
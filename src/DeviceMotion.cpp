@@ -0,0 +1,121 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdexcept>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#if CV_MAJOR_VERSION >= 3
+#include <opencv2/core/ocl.hpp>
+#endif /* CV_MAJOR_VERSION >= 3 */
+
+#include <labgen-p/DeviceMotion.hpp>
+
+/* ========================================================================== *
+ * DeviceMotion                                                               *
+ * ========================================================================== */
+
+bool DeviceMotion::isAvailable() {
+#if CV_MAJOR_VERSION >= 3
+  return cv::ocl::haveOpenCL() && cv::ocl::useOpenCL();
+#else
+  return false;
+#endif /* CV_MAJOR_VERSION >= 3 */
+}
+
+/******************************************************************************/
+
+DeviceMotion::DeviceMotion(const std::vector<int32_t>& kernelSizes) :
+kernelSizes(kernelSizes),
+current(0),
+primed(false) {
+  if (!isAvailable())
+    throw std::runtime_error("No OpenCL device is available!");
+
+#if CV_MAJOR_VERSION >= 3
+  deviceQuantities.resize(kernelSizes.size());
+#endif /* CV_MAJOR_VERSION >= 3 */
+}
+
+/******************************************************************************/
+
+void DeviceMotion::process(
+  const cv::Mat& img_input,
+  std::vector<cv::Mat>& quantities
+) {
+#if CV_MAJOR_VERSION >= 3
+  /* The previous luma is kept, the other buffer receiving the current one. */
+  current = 1 - current;
+
+  /* A single channel is already a luma. */
+  if (img_input.channels() == 1)
+    img_input.copyTo(luma[current]);
+  else {
+    img_input.copyTo(frame);
+    cv::cvtColor(frame, luma[current], CV_BGR2GRAY);
+  }
+
+  if (!primed) {
+    primed = true;
+    return;
+  }
+
+  cv::absdiff(luma[current], luma[1 - current], scores);
+
+  for (size_t n = 0; n < kernelSizes.size(); ++n) {
+    cv::boxFilter(
+      scores,
+      deviceQuantities[n],
+      quantities[n].depth(),
+      cv::Size(kernelSizes[n], kernelSizes[n]),
+      cv::Point(-1, -1),
+      false,
+      cv::BORDER_CONSTANT
+    );
+
+    /* The matrix has the right size and type, and is thus not reallocated. */
+    deviceQuantities[n].copyTo(quantities[n]);
+  }
+#else
+  (void) img_input;
+  (void) quantities;
+#endif /* CV_MAJOR_VERSION >= 3 */
+}
+
+/******************************************************************************/
+
+void DeviceMotion::getLuma(cv::Mat& luma) const {
+#if CV_MAJOR_VERSION >= 3
+  this->luma[current].copyTo(luma);
+#else
+  (void) luma;
+#endif /* CV_MAJOR_VERSION >= 3 */
+}
+
+/******************************************************************************/
+
+void DeviceMotion::prime(const cv::Mat& previous) {
+  if (previous.type() != CV_8UC1)
+    throw std::runtime_error("Only CV_8UC1 lumas are supported!");
+
+#if CV_MAJOR_VERSION >= 3
+  previous.copyTo(luma[current]);
+#endif /* CV_MAJOR_VERSION >= 3 */
+
+  primed = true;
+}
@@ -16,9 +16,8 @@
  * You should have received a copy of the GNU General Public License
  * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
  */
-#include <algorithm>
-#include <cmath>
 #include <cstdlib>
+#include <stdexcept>
 
 #include <labgen-p/FrameDifferenceC1L1.hpp>
 
@@ -27,27 +26,191 @@
  * ========================================================================== */
 
 void FrameDifferenceC1L1::process(const cv::Mat& img_input, cv::Mat& proba_map) {
-  if(img_input.empty())
+  if (!swap(img_input))
     return;
 
-  cv::Mat cinput;
+  switch (proba_map.depth()) {
+    case CV_8U:
+      processRows<false, uint8_t>(img_input, &proba_map, NULL);
+      break;
+    case CV_32S:
+      processRows<false, int32_t>(img_input, &proba_map, NULL);
+      break;
+    default:
+      throw std::runtime_error("Only CV_8UC1 and CV_32SC1 scores are supported!");
+  }
+}
+
+/******************************************************************************/
 
-  if (img_input.channels() != 1)
-    cv::cvtColor(img_input, cinput, CV_BGR2GRAY);
-  else
-    cinput = img_input;
+void FrameDifferenceC1L1::process(
+  const cv::Mat& img_input,
+  SummedAreaTables<int32_t>& sums
+) {
+  if (!swap(img_input))
+    return;
+
+  sums.allocate(img_input.rows, img_input.cols);
 
-  if(img_input_prev.empty()) {
-    cinput.copyTo(img_input_prev);
+  if (pool == NULL || pool->size() == 1) {
+    processRows<true, int32_t>(img_input, NULL, &sums);
     return;
   }
 
-  const unsigned char* input      = cinput.data;
-  const unsigned char* input_prev = img_input_prev.data;
-              int32_t* proba      = reinterpret_cast<int32_t*>(proba_map.data);
+  /* The row 0 of the table is made of zeros. */
+  const int32_t* zeros = sums.getPaddedRow(0) + 1;
+
+  pool->parallelFor(0, img_input.rows, [&](size_t begin, size_t end) {
+    for (size_t row = begin; row < end; ++row)
+      processRow<true, int32_t>(img_input, row, sums.getPaddedRow(row + 1) + 1, zeros);
+  });
+
+  pool->parallelFor(0, img_input.cols, [&](size_t begin, size_t end) {
+    sums.accumulateRows(begin, end);
+  });
+}
+
+/******************************************************************************/
+
+bool FrameDifferenceC1L1::update(const cv::Mat& img_input) {
+  if (!swap(img_input))
+    return false;
+
+  processRows<false, uint8_t>(img_input, NULL, NULL);
+
+  return true;
+}
+
+/******************************************************************************/
+
+void FrameDifferenceC1L1::allocate(int rows, int cols) {
+  luma[0].create(rows, cols, CV_8UC1);
+  luma[1].create(rows, cols, CV_8UC1);
+}
+
+/******************************************************************************/
+
+void FrameDifferenceC1L1::prime(const cv::Mat& previous) {
+  if (previous.type() != CV_8UC1)
+    throw std::runtime_error("The luma must be a CV_8UC1 matrix!");
+
+  previous.copyTo(luma[current]);
+  primed = true;
+}
+
+/******************************************************************************/
+
+bool FrameDifferenceC1L1::swap(const cv::Mat& img_input) {
+  if (img_input.empty())
+    return false;
+
+  if (img_input.depth() != CV_8U)
+    throw std::runtime_error("Only 8-bit frames are supported!");
+
+  current = 1 - current;
+  luma[current].create(img_input.rows, img_input.cols, CV_8UC1);
 
-  for (int i = 0; i < img_input.rows * img_input.cols; ++i)
-    *(proba++) = abs((int32_t)(*(input++)) - *(input_prev++));
+  /* First frame: only its luma is needed. */
+  if (!primed || luma[1 - current].size() != img_input.size()) {
+    processRows<false, uint8_t>(img_input, NULL, NULL);
+    primed = true;
 
-  cinput.copyTo(img_input_prev);
+    return false;
+  }
+
+  return true;
+}
+
+/******************************************************************************/
+
+template <bool Integral, typename Score>
+void FrameDifferenceC1L1::processRows(
+  const cv::Mat& img_input,
+  cv::Mat* proba_map,
+  SummedAreaTables<int32_t>* sums
+) {
+  /* The rows of the summed area table depend on each other. */
+  ThreadPool* rowsPool = Integral ? NULL : pool;
+
+  ThreadPool::run(rowsPool, 0, img_input.rows, [&](size_t begin, size_t end) {
+    for (size_t row = begin; row < end; ++row) {
+      Score* proba = NULL;
+      const int32_t* above = NULL;
+
+      if (Integral) {
+        proba = reinterpret_cast<Score*>(sums->getPaddedRow(row + 1) + 1);
+        above = sums->getPaddedRow(row) + 1;
+      }
+      else if (proba_map != NULL)
+        proba = proba_map->ptr<Score>(row);
+
+      processRow<Integral, Score>(img_input, row, proba, above);
+    }
+  });
+}
+
+/******************************************************************************/
+
+template <bool Integral, typename Score>
+void FrameDifferenceC1L1::processRow(
+  const cv::Mat& img_input,
+  int row,
+  Score* proba,
+  const int32_t* above
+) {
+  switch (img_input.channels()) {
+    case 1:
+      processChannels<1, Integral, Score>(img_input, row, proba, above);
+      break;
+    case 3:
+      processChannels<3, Integral, Score>(img_input, row, proba, above);
+      break;
+    case 4:
+      processChannels<4, Integral, Score>(img_input, row, proba, above);
+      break;
+    default:
+      throw std::runtime_error("Only 1, 3, or 4 channels are supported!");
+  }
+}
+
+/******************************************************************************/
+
+/*
+ * With a NULL proba, only the luma of the row is computed. Otherwise, proba
+ * receives either the motion scores, or the row of the summed area table whose
+ * row above is above, Score being then int32_t.
+ */
+template <int Channels, bool Integral, typename Score>
+void FrameDifferenceC1L1::processChannels(
+  const cv::Mat& img_input,
+  int row,
+  Score* proba,
+  const int32_t* above
+) {
+  const unsigned char* input      = img_input.ptr<unsigned char>(row);
+        unsigned char* input_luma = luma[current].ptr<unsigned char>(row);
+  const unsigned char* input_prev = luma[1 - current].ptr<unsigned char>(row);
+
+  int32_t rowSum = 0;
+
+  for (int col = 0; col < img_input.cols; ++col, input += Channels) {
+    /* Fixed-point BT.601 coefficients of OpenCV, with a 14 bits shift. */
+    int32_t y = (Channels == 1) ?
+      input[0] :
+      (input[0] * 1868 + input[1] * 9617 + input[2] * 4899 + (1 << 13)) >> 14;
+
+    input_luma[col] = static_cast<unsigned char>(y);
+
+    if (proba == NULL)
+      continue;
+
+    int32_t score = std::abs(y - input_prev[col]);
+
+    if (Integral) {
+      rowSum += score;
+      proba[col] = static_cast<Score>(above[col] + rowSum);
+    }
+    else
+      proba[col] = static_cast<Score>(score);
+  }
 }
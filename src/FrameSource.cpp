@@ -0,0 +1,114 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdexcept>
+
+#include <sys/stat.h>
+
+#include <labgen-p/FrameSource.hpp>
+
+/* ========================================================================== *
+ * VideoSource                                                                *
+ * ========================================================================== */
+
+VideoSource::VideoSource(cv::VideoCapture& decoder) :
+decoder(decoder),
+height(decoder.get(CV_CAP_PROP_FRAME_HEIGHT)),
+width(decoder.get(CV_CAP_PROP_FRAME_WIDTH)) {}
+
+/******************************************************************************/
+
+size_t VideoSource::getFrameCount() const {
+  double count = decoder.get(CV_CAP_PROP_FRAME_COUNT);
+
+  return (count > 0) ? static_cast<size_t>(count) : 0;
+}
+
+/* ========================================================================== *
+ * I420Source                                                                 *
+ * ========================================================================== */
+
+I420Source::I420Source(const std::string& path, int height, int width) :
+file(NULL),
+height(height),
+width(width),
+frameSize(static_cast<size_t>(height) * width * 3 / 2),
+skipped() {
+  if (height < 2 || width < 2 || height % 2 != 0 || width % 2 != 0)
+    throw std::runtime_error("The size of I420 frames must be even and positive!");
+
+  file = (path == "-") ? stdin : std::fopen(path.c_str(), "rb");
+
+  if (file == NULL)
+    throw std::runtime_error("Cannot open the '" + path + "' sequence.");
+}
+
+/******************************************************************************/
+
+I420Source::~I420Source() {
+  release();
+}
+
+/******************************************************************************/
+
+bool I420Source::read(cv::Mat& frame) {
+  if (file == NULL)
+    return false;
+
+  frame.create(height * 3 / 2, width, CV_8UC1);
+
+  return std::fread(frame.data, 1, frameSize, file) == frameSize;
+}
+
+/******************************************************************************/
+
+bool I420Source::grab() {
+  if (file == NULL)
+    return false;
+
+  /*
+   * Seeking past the end of a file is allowed: the last byte of the frame is
+   * read to check that the frame is complete.
+   */
+  if (std::fseek(file, frameSize - 1, SEEK_CUR) == 0)
+    return std::fgetc(file) != EOF;
+
+  skipped.resize(frameSize);
+  return std::fread(skipped.data(), 1, frameSize, file) == frameSize;
+}
+
+/******************************************************************************/
+
+size_t I420Source::getFrameCount() const {
+  struct stat status;
+
+  /* The standard input, or a pipe, has no known size. */
+  if (file == NULL || fstat(fileno(file), &status) != 0 || !S_ISREG(status.st_mode))
+    return 0;
+
+  return static_cast<size_t>(status.st_size) / frameSize;
+}
+
+/******************************************************************************/
+
+void I420Source::release() {
+  if (file != NULL && file != stdin)
+    std::fclose(file);
+
+  file = NULL;
+}
@@ -0,0 +1,90 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cstdint>
+
+#include <labgen-p/I420.hpp>
+
+/* ========================================================================== *
+ * I420                                                                       *
+ * ========================================================================== */
+
+void I420::interleave(const cv::Mat& frame, cv::Mat& yuv, ThreadPool* pool) {
+  int height = getHeight(frame.rows);
+  int width = frame.cols;
+
+  const uint8_t* uPlane = frame.ptr<uint8_t>(height);
+  const uint8_t* vPlane = uPlane + (height / 2) * (width / 2);
+
+  ThreadPool::run(pool, 0, height, [&](size_t begin, size_t end) {
+    for (size_t row = begin; row < end; ++row) {
+      const uint8_t* y = frame.ptr<uint8_t>(row);
+      const uint8_t* u = uPlane + (row / 2) * (width / 2);
+      const uint8_t* v = vPlane + (row / 2) * (width / 2);
+      uint8_t* output = yuv.ptr<uint8_t>(row);
+
+      for (int col = 0; col < width; col += 2, output += 6) {
+        output[0] = y[col];
+        output[1] = u[col / 2];
+        output[2] = v[col / 2];
+        output[3] = y[col + 1];
+        output[4] = u[col / 2];
+        output[5] = v[col / 2];
+      }
+    }
+  });
+}
+
+/******************************************************************************/
+
+void I420::toBGR(const cv::Mat& yuv, cv::Mat& bgr, ThreadPool* pool) {
+  bgr.create(yuv.rows, yuv.cols, CV_8UC3);
+
+  ThreadPool::run(pool, 0, yuv.rows, [&](size_t begin, size_t end) {
+    for (size_t row = begin; row < end; ++row)
+      toBGR(yuv.ptr<uint8_t>(row), bgr.ptr<uint8_t>(row), yuv.cols);
+  });
+}
+
+/******************************************************************************/
+
+void I420::toBGR(const uint8_t* yuv, uint8_t* bgr, size_t pixels) {
+  /* Coefficients of OpenCV, with a 20 bits shift. */
+  const int32_t SHIFT = 20;
+  const int32_t HALF  = 1 << (SHIFT - 1);
+  const int32_t CY    = 1220542;
+  const int32_t CVR   = 1673527;
+  const int32_t CVG   = -852492;
+  const int32_t CUG   = -409993;
+  const int32_t CUB   = 2116026;
+
+  for (size_t i = 0; i < pixels; ++i, yuv += 3, bgr += 3) {
+    int32_t y = std::max(0, yuv[0] - 16) * CY;
+    int32_t u = yuv[1] - 128;
+    int32_t v = yuv[2] - 128;
+
+    int32_t b = (y + HALF + CUB * u) >> SHIFT;
+    int32_t g = (y + HALF + CVG * v + CUG * u) >> SHIFT;
+    int32_t r = (y + HALF + CVR * v) >> SHIFT;
+
+    bgr[0] = static_cast<uint8_t>(std::min(std::max(b, 0), 255));
+    bgr[1] = static_cast<uint8_t>(std::min(std::max(g, 0), 255));
+    bgr[2] = static_cast<uint8_t>(std::min(std::max(r, 0), 255));
+  }
+}
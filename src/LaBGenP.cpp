@@ -0,0 +1,725 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <labgen-p/Decimation.hpp>
+#include <labgen-p/LaBGenP.hpp>
+#include <labgen-p/MappedFile.hpp>
+
+/* ========================================================================== *
+ * Checkpoints                                                                *
+ * ========================================================================== */
+
+static const char CHECKPOINT_MAGIC[8] = {'L', 'a', 'B', 'G', 'e', 'n', 'P', '5'};
+
+/******************************************************************************/
+
+template <typename T>
+static void writeValue(std::ostream& stream, T value) {
+  stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+/******************************************************************************/
+
+/* Returns the next bytes of a checkpoint, and moves the cursor past them. */
+static const uint8_t* readBytes(
+  const uint8_t*& cursor,
+  const uint8_t* end,
+  size_t bytes
+) {
+  if (static_cast<size_t>(end - cursor) < bytes)
+    throw std::runtime_error("The checkpoint is truncated!");
+
+  const uint8_t* data = cursor;
+  cursor += bytes;
+
+  return data;
+}
+
+/******************************************************************************/
+
+/* Returns the cursor following the magic number of a mapped checkpoint. */
+static const uint8_t* openCheckpoint(const MappedFile& file, const std::string& path) {
+  if (
+    file.getSize() < sizeof(CHECKPOINT_MAGIC) ||
+    std::memcmp(file.getData(), CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0
+  )
+    throw std::runtime_error("'" + path + "' is not a checkpoint!");
+
+  return file.getData() + sizeof(CHECKPOINT_MAGIC);
+}
+
+/******************************************************************************/
+
+template <typename T>
+static T readValue(const uint8_t*& cursor, const uint8_t* end) {
+  T value;
+  std::memcpy(&value, readBytes(cursor, end, sizeof(T)), sizeof(T));
+
+  return value;
+}
+
+/* ========================================================================== *
+ * Timings                                                                    *
+ * ========================================================================== */
+
+/* Seconds elapsed since start, which then moves to the current time. */
+static double elapsed(std::chrono::steady_clock::time_point& start) {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(now - start).count();
+
+  start = now;
+
+  return seconds;
+}
+
+/* ========================================================================== *
+ * LaBGenP                                                                    *
+ * ========================================================================== */
+
+LaBGenP::LaBGenP(
+  int32_t height,
+  int32_t width,
+  const Parameters& params,
+  ThreadPool* pool
+) :
+params(normalize(params)),
+height(height),
+width(width),
+motionHeight(Decimation::getReducedSize(height, this->params.downscale)),
+motionWidth(Decimation::getReducedSize(width, this->params.downscale)),
+ownPool(pool == NULL ? new ThreadPool(this->params.threads) : NULL),
+pool(pool == NULL ? ownPool.get() : pool),
+fdiff(this->pool),
+filters(),
+quantitiesMotion(),
+decimation(),
+decimated(),
+reducedQuantitiesMotion(),
+yuvFrame(),
+yuvBackground(),
+histories(),
+usesSums(true),
+motionScores(),
+sums(),
+device(),
+tiled(),
+numFrames(0),
+timings() {
+  if (height < 1 || width < 1)
+    throw std::logic_error("The size of the frames must be positive");
+
+  bool yuv = (this->params.format == "i420");
+
+  if (yuv && (height % 2 != 0 || width % 2 != 0))
+    throw std::logic_error("The size of I420 frames must be even");
+
+  if (yuv) {
+    yuvFrame = cv::Mat(height, width, CV_8UC3);
+    yuvBackground = cv::Mat(height, width, CV_8UC3, cv::Scalar(0, 0, 0));
+  }
+
+  /* The frame difference of I420 frames only needs their Y plane. */
+  if (this->params.downscale > 1)
+    decimated = cv::Mat(motionHeight, motionWidth, yuv ? CV_8UC1 : CV_8UC3);
+
+  /* Pixel level, or segments x segments patches. */
+  Utils::ROIs rois = Utils::getROIs(height, width, this->params.segments);
+  std::vector<int32_t> kernelSizes;
+
+  for (size_t n = 0; n < this->params.nParams.size(); ++n) {
+    int32_t kernelSize =
+      (std::min(motionHeight, motionWidth) / this->params.nParams[n]) | 1;
+
+    filters.push_back(
+      MotionProba::create(this->params.filter, kernelSize, this->pool)
+    );
+
+    kernelSizes.push_back(kernelSize);
+
+    int encoding = getEncoding(this->params, height, width, this->params.nParams[n]);
+
+    quantitiesMotion.push_back(cv::Mat(height, width, encoding));
+
+    if (this->params.downscale > 1)
+      reducedQuantitiesMotion.push_back(cv::Mat(motionHeight, motionWidth, encoding));
+    else
+      reducedQuantitiesMotion.push_back(quantitiesMotion.back());
+
+    histories.push_back(
+      BasePatchesHistory::create(
+        rois,
+        this->params.sParams.back(),
+        this->pool,
+        encoding,
+        this->params.backing
+      )
+    );
+
+    usesSums = usesSums && filters.back()->usesSums();
+  }
+
+  if (this->params.device == "opencl" && DeviceMotion::isAvailable()) {
+    device.reset(new DeviceMotion(kernelSizes));
+    return;
+  }
+
+  fdiff.allocate(motionHeight, motionWidth);
+
+  /* The tiles only need the lumas of the frame difference. */
+  if (
+    this->params.tiles > 0 &&
+    this->params.segments == 0 &&
+    this->params.downscale == 1
+  ) {
+    tiled.reset(new TiledPipeline(kernelSizes, this->params.tiles, this->pool));
+    return;
+  }
+
+  /* The motion scores are absolute differences of 8-bit lumas. */
+  if (usesSums)
+    sums.allocate(motionHeight, motionWidth);
+  else
+    motionScores = cv::Mat(motionHeight, motionWidth, CV_8UC1);
+}
+
+/******************************************************************************/
+
+size_t LaBGenP::pushFrame(const cv::Mat& frame) {
+  return process(frame, NULL);
+}
+
+/******************************************************************************/
+
+size_t LaBGenP::pushFrame(const cv::Mat& frame, const std::vector<cv::Mat>& quantities) {
+  if (device)
+    throw std::logic_error("The quantities of motion are computed on a device");
+
+  if (quantities.size() != reducedQuantitiesMotion.size())
+    throw std::logic_error("One map of quantities of motion per value of N is needed");
+
+  for (size_t n = 0; n < quantities.size(); ++n) {
+    if (
+      quantities[n].size() != reducedQuantitiesMotion[n].size() ||
+      quantities[n].type() != reducedQuantitiesMotion[n].type() ||
+      !quantities[n].isContinuous()
+    )
+      throw std::runtime_error("The quantities of motion do not match the engine!");
+  }
+
+  return process(frame, &quantities);
+}
+
+/******************************************************************************/
+
+size_t LaBGenP::process(const cv::Mat& frame, const std::vector<cv::Mat>* quantities) {
+  bool yuv = !yuvFrame.empty();
+
+  if (frame.rows != (yuv ? height * 3 / 2 : height) || frame.cols != width)
+    throw std::runtime_error("The size of the frame does not match the engine!");
+
+  if (frame.type() != (yuv ? CV_8UC1 : CV_8UC3) || !frame.isContinuous())
+    throw std::runtime_error("The frame is not a continuous frame of the format of the engine!");
+
+  ++numFrames;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  cv::Mat luma;
+  const cv::Mat* motionFrame = &frame;
+  const cv::Mat* colors = &frame;
+
+  if (yuv) {
+    luma = I420::getLuma(frame);
+    motionFrame = &luma;
+  }
+
+  if (params.downscale > 1) {
+    decimation.decimate(*motionFrame, decimated, params.downscale, pool);
+    motionFrame = &decimated;
+  }
+
+  /*
+   * Background subtraction. When the filters work on summed area tables, the
+   * motion scores are accumulated into the table in the same pass. A device
+   * also filters the motion scores, and the tiles compute them from the lumas.
+   * Given quantities of motion only need the luma.
+   */
+  bool differs = true;
+
+  if (device)
+    device->process(*motionFrame, reducedQuantitiesMotion);
+  else if (quantities != NULL || tiled)
+    differs = fdiff.update(*motionFrame);
+  else if (usesSums)
+    fdiff.process(*motionFrame, sums);
+  else
+    fdiff.process(*motionFrame, motionScores);
+
+  timings.difference += elapsed(start);
+
+  if (numFrames == 1 || !differs)
+    return 0;
+
+  /* The samples are stored as they are received. */
+  if (yuv) {
+    I420::interleave(frame, yuvFrame, pool);
+    colors = &yuvFrame;
+  }
+
+  size_t modified = 0;
+
+  if (tiled && quantities == NULL) {
+    modified = tiled->process(
+      fdiff.getLuma(),
+      fdiff.getPreviousLuma(),
+      *colors,
+      quantitiesMotion,
+      histories
+    );
+
+    for (size_t n = 0; params.aging > 0 && n < histories.size(); ++n)
+      histories[n]->age(params.aging);
+
+    timings.insertion += elapsed(start);
+
+    return modified;
+  }
+
+  for (size_t n = 0; n < filters.size(); ++n) {
+    /* Filtering probability map, unless done by the device or given. */
+    const cv::Mat* reduced = &reducedQuantitiesMotion[n];
+
+    if (quantities != NULL)
+      reduced = &(*quantities)[n];
+    else if (!device && usesSums)
+      filters[n]->computeFromSums(sums, reducedQuantitiesMotion[n]);
+    else if (!device)
+      filters[n]->compute(motionScores, reducedQuantitiesMotion[n]);
+
+    /* The given quantities of motion are inserted as is at full resolution. */
+    const cv::Mat* inserted = reduced;
+
+    if (params.downscale > 1) {
+      Decimation::replicate(*reduced, quantitiesMotion[n], params.downscale, pool);
+      inserted = &quantitiesMotion[n];
+    }
+
+    timings.filtering += elapsed(start);
+
+    /* Insert the current frame and its probability map into the history. */
+    modified += histories[n]->insert(*inserted, *colors);
+
+    if (params.aging > 0)
+      histories[n]->age(params.aging);
+
+    timings.insertion += elapsed(start);
+  }
+
+  return modified;
+}
+
+/******************************************************************************/
+
+void LaBGenP::getBackground(cv::Mat& background) const {
+  getBackground(background, params.sParams.front(), params.nParams.front());
+}
+
+/******************************************************************************/
+
+void LaBGenP::getBackground(cv::Mat& background, int32_t s, int32_t n) const {
+  std::vector<int32_t>::const_iterator it =
+    std::find(params.nParams.begin(), params.nParams.end(), n);
+
+  if (it == params.nParams.end() || s < 1 || s > params.sParams.back())
+    throw std::logic_error("The (S, N) pair is not among the parameters");
+
+  prepareBackground(background);
+  histories[it - params.nParams.begin()]->median(background, s);
+
+  if (!yuvFrame.empty())
+    I420::toBGR(background, background, pool);
+}
+
+/******************************************************************************/
+
+void LaBGenP::updateBackground(cv::Mat& background) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  const uint8_t* previous = background.data;
+  prepareBackground(background);
+
+  if (!yuvFrame.empty() && background.data != previous) {
+    /* A new background is converted at once. */
+    histories.front()->updateMedian(yuvBackground, params.sParams.front());
+    I420::toBGR(yuvBackground, background, pool);
+  }
+  else if (!yuvFrame.empty()) {
+    /* Otherwise, only the pixels recomputed are converted again. */
+    const uint8_t* yuv = yuvBackground.data;
+    uint8_t* bgr = background.data;
+
+    histories.front()->updateMedian(
+      yuvBackground,
+      params.sParams.front(),
+      [&](size_t begin, size_t end) {
+        I420::toBGR(yuv + begin * 3, bgr + begin * 3, end - begin);
+      }
+    );
+  }
+  else
+    histories.front()->updateMedian(background, params.sParams.front());
+
+  timings.median += elapsed(start);
+}
+
+/******************************************************************************/
+
+void LaBGenP::reset() {
+  fdiff.reset();
+
+  if (device)
+    device->reset();
+
+  for (size_t n = 0; n < histories.size(); ++n)
+    histories[n]->clear();
+
+  numFrames = 0;
+  timings = Timings();
+}
+
+/******************************************************************************/
+
+void LaBGenP::save(const std::string& path) const {
+  std::string temporary = path + ".tmp";
+  std::ofstream stream(temporary.c_str(), std::ios::binary | std::ios::trunc);
+
+  if (!stream)
+    throw std::runtime_error("Cannot create the '" + temporary + "' checkpoint.");
+
+  stream.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+
+  writeValue<uint32_t>(stream, height);
+  writeValue<uint32_t>(stream, width);
+  writeValue<uint32_t>(stream, params.segments);
+  writeValue<uint32_t>(stream, params.downscale);
+  writeValue<uint32_t>(stream, !yuvFrame.empty());
+  writeValue<uint32_t>(stream, params.sParams.back());
+  writeValue<uint32_t>(stream, params.nParams.size());
+  writeValue<uint32_t>(stream, isPrimed());
+  writeValue<uint64_t>(stream, numFrames);
+  writeValue<uint32_t>(stream, params.stride);
+
+  for (size_t n = 0; n < params.nParams.size(); ++n) {
+    writeValue<int32_t>(stream, params.nParams[n]);
+    writeValue<uint32_t>(stream, histories[n]->keySize);
+  }
+
+  if (isPrimed()) {
+    cv::Mat luma;
+    getLuma(luma);
+
+    for (int32_t row = 0; row < motionHeight; ++row)
+      stream.write(reinterpret_cast<const char*>(luma.ptr(row)), motionWidth);
+  }
+
+  for (size_t n = 0; n < histories.size(); ++n)
+    histories[n]->save(stream);
+
+  stream.close();
+
+  if (!stream)
+    throw std::runtime_error("Cannot write the '" + temporary + "' checkpoint.");
+
+  if (std::rename(temporary.c_str(), path.c_str()) != 0)
+    throw std::runtime_error("Cannot rename the checkpoint to '" + path + "'.");
+}
+
+/******************************************************************************/
+
+void LaBGenP::load(const std::string& path) {
+  MappedFile file(path);
+
+  const uint8_t* cursor = openCheckpoint(file, path);
+  const uint8_t* end = file.getData() + file.getSize();
+
+  uint32_t savedHeight   = readValue<uint32_t>(cursor, end);
+  uint32_t savedWidth    = readValue<uint32_t>(cursor, end);
+  uint32_t savedSegments = readValue<uint32_t>(cursor, end);
+  uint32_t savedScale    = readValue<uint32_t>(cursor, end);
+  uint32_t savedYUV      = readValue<uint32_t>(cursor, end);
+  uint32_t savedS        = readValue<uint32_t>(cursor, end);
+  uint32_t savedNCount   = readValue<uint32_t>(cursor, end);
+  uint32_t savedPrimed   = readValue<uint32_t>(cursor, end);
+  uint64_t savedFrames   = readValue<uint64_t>(cursor, end);
+  uint32_t savedStride   = readValue<uint32_t>(cursor, end);
+
+  bool matches =
+    savedHeight   == static_cast<uint32_t>(height)                 &&
+    savedWidth    == static_cast<uint32_t>(width)                  &&
+    savedSegments == static_cast<uint32_t>(params.segments)        &&
+    savedScale    == static_cast<uint32_t>(params.downscale)       &&
+    savedYUV      == static_cast<uint32_t>(!yuvFrame.empty())      &&
+    savedS        == static_cast<uint32_t>(params.sParams.back())  &&
+    savedStride   == static_cast<uint32_t>(params.stride)          &&
+    savedNCount   == params.nParams.size();
+
+  for (size_t n = 0; matches && n < params.nParams.size(); ++n) {
+    matches =
+      (readValue<int32_t>(cursor, end) == params.nParams[n]) &&
+      (readValue<uint32_t>(cursor, end) == histories[n]->keySize);
+  }
+
+  if (!matches)
+    throw std::runtime_error("The '" + path + "' checkpoint does not match the engine!");
+
+  /* Everything is checked before the state of the engine is modified. */
+  const uint8_t* luma = NULL;
+
+  if (savedPrimed)
+    luma = readBytes(cursor, end, static_cast<size_t>(motionHeight) * motionWidth);
+
+  std::vector<const uint8_t*> states;
+
+  for (size_t n = 0; n < histories.size(); ++n) {
+    states.push_back(readBytes(cursor, end, histories[n]->getStateSize()));
+    histories[n]->check(states.back());
+  }
+
+  if (luma != NULL)
+    prime(cv::Mat(motionHeight, motionWidth, CV_8UC1, const_cast<uint8_t*>(luma)));
+  else {
+    fdiff.reset();
+
+    if (device)
+      device->reset();
+  }
+
+  for (size_t n = 0; n < histories.size(); ++n)
+    histories[n]->load(states[n]);
+
+  numFrames = savedFrames;
+}
+
+/******************************************************************************/
+
+cv::Size LaBGenP::getCheckpointSize(const std::string& path) {
+  MappedFile file(path);
+
+  const uint8_t* cursor = openCheckpoint(file, path);
+  const uint8_t* end = file.getData() + file.getSize();
+
+  uint32_t savedHeight = readValue<uint32_t>(cursor, end);
+  uint32_t savedWidth  = readValue<uint32_t>(cursor, end);
+
+  return cv::Size(savedWidth, savedHeight);
+}
+
+/******************************************************************************/
+
+size_t LaBGenP::merge(const LaBGenP& newer) {
+  if (
+    newer.height != height || newer.width != width ||
+    newer.params.segments != params.segments ||
+    newer.params.downscale != params.downscale ||
+    newer.params.aging != 0 || params.aging != 0 ||
+    newer.params.format != params.format ||
+    newer.params.stride != params.stride ||
+    newer.params.sParams.back() != params.sParams.back() ||
+    newer.params.nParams != params.nParams
+  )
+    throw std::logic_error("Only engines with the same parameters and no aging can be merged");
+
+  size_t modified = 0;
+
+  for (size_t n = 0; n < histories.size(); ++n)
+    modified += histories[n]->merge(*(newer.histories[n]));
+
+  if (newer.isPrimed()) {
+    cv::Mat luma;
+    newer.getLuma(luma);
+
+    prime(luma);
+  }
+
+  /* The first frame of newer, which only primed it, is the last one of this engine. */
+  numFrames += newer.numFrames;
+
+  if (newer.isPrimed() && newer.numFrames > 0)
+    --numFrames;
+
+  return modified;
+}
+
+/******************************************************************************/
+
+size_t LaBGenP::getMemory(const Parameters& params, int32_t height, int32_t width) {
+  Parameters normalized = normalize(params);
+
+  size_t pixels = static_cast<size_t>(height) * width;
+  Utils::ROIs rois = Utils::getROIs(height, width, normalized.segments);
+
+  int32_t motionHeight = Decimation::getReducedSize(height, normalized.downscale);
+  int32_t motionWidth = Decimation::getReducedSize(width, normalized.downscale);
+  size_t motionPixels = static_cast<size_t>(motionHeight) * motionWidth;
+
+  bool tiled =
+    normalized.tiles > 0 && normalized.segments == 0 && normalized.downscale == 1;
+
+  size_t memory = 2 * motionPixels;
+
+  /* The tiles do not need the summed area table. */
+  if (!tiled)
+    memory += (motionHeight + 1) * (motionWidth + 1) * sizeof(MotionProba::ProbaMapEncoding);
+
+  if (normalized.downscale > 1)
+    memory += motionPixels * CHANNELS;
+
+  if (normalized.format == "i420")
+    memory += 2 * pixels * CHANNELS;
+
+  for (size_t n = 0; n < normalized.nParams.size(); ++n) {
+    int encoding = getEncoding(normalized, height, width, normalized.nParams[n]);
+    size_t keySize = (encoding == CV_16UC1) ? sizeof(uint16_t) : sizeof(int32_t);
+
+    memory += pixels * keySize;
+
+    /* The arenas backed by files can be paged out. */
+    if (normalized.backing.empty())
+      memory += BasePatchesHistory::getArenaSize(rois, normalized.sParams.back(), keySize);
+
+    if (normalized.downscale > 1)
+      memory += motionPixels * keySize;
+  }
+
+  return memory;
+}
+
+/******************************************************************************/
+
+size_t LaBGenP::getHistoriesMemory() const {
+  size_t memory = 0;
+
+  for (size_t n = 0; n < histories.size(); ++n)
+    memory += BasePatchesHistory::getArenaSize(
+      histories[n]->rois,
+      histories[n]->bufferSize,
+      histories[n]->keySize
+    );
+
+  return memory;
+}
+
+/******************************************************************************/
+
+int LaBGenP::getEncoding(
+  const Parameters& params,
+  int32_t height,
+  int32_t width,
+  int32_t n
+) {
+  if (params.aging > 0)
+    return CV_32SC1;
+
+  int32_t kernelSize = std::min(
+    Decimation::getReducedSize(height, params.downscale),
+    Decimation::getReducedSize(width, params.downscale)
+  ) / n | 1;
+
+  return MotionProba::create(params.filter, kernelSize)->getOpenCVEncoding();
+}
+
+/******************************************************************************/
+
+LaBGenP::Parameters LaBGenP::normalize(const Parameters& params) {
+  Parameters normalized(params);
+
+  std::vector<int32_t>& sParams = normalized.sParams;
+  std::vector<int32_t>& nParams = normalized.nParams;
+
+  if (sParams.empty() || nParams.empty())
+    throw std::logic_error("At least one value of S and N must be given");
+
+  std::sort(sParams.begin(), sParams.end());
+  sParams.erase(std::unique(sParams.begin(), sParams.end()), sParams.end());
+
+  std::sort(nParams.begin(), nParams.end());
+  nParams.erase(std::unique(nParams.begin(), nParams.end()), nParams.end());
+
+  if (sParams.front() < 1)
+    throw std::logic_error("The S parameter must be positive");
+
+  if (nParams.front() < 1)
+    throw std::logic_error("The N parameter must be positive");
+
+  if (normalized.segments < 0)
+    throw std::logic_error("The number of segments cannot be negative");
+
+  if (normalized.threads < 0)
+    throw std::logic_error("The number of threads cannot be negative");
+
+  if (normalized.downscale < 1)
+    throw std::logic_error("The downscale factor must be positive");
+
+  if (normalized.device != "cpu" && normalized.device != "opencl")
+    throw std::logic_error("The device must be either cpu or opencl");
+
+  if (normalized.format != "bgr" && normalized.format != "i420")
+    throw std::logic_error("The format must be either bgr or i420");
+
+  if (normalized.tiles < 0)
+    throw std::logic_error("The number of tiles cannot be negative");
+
+  return normalized;
+}
+
+/******************************************************************************/
+
+void LaBGenP::prepareBackground(cv::Mat& background) const {
+  background.create(height, width, CV_8UC3);
+}
+
+/******************************************************************************/
+
+bool LaBGenP::isPrimed() const {
+  return device ? device->isPrimed() : fdiff.isPrimed();
+}
+
+/******************************************************************************/
+
+void LaBGenP::getLuma(cv::Mat& luma) const {
+  if (device)
+    device->getLuma(luma);
+  else
+    luma = fdiff.getLuma();
+}
+
+/******************************************************************************/
+
+void LaBGenP::prime(const cv::Mat& luma) {
+  if (device)
+    device->prime(luma);
+  else
+    fdiff.prime(luma);
+}
@@ -0,0 +1,108 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <labgen-p/MappedFile.hpp>
+
+/* ========================================================================== *
+ * MappedFile                                                                 *
+ * ========================================================================== */
+
+MappedFile::MappedFile(const std::string& path) : data(NULL), length(0) {
+  int fd = open(path.c_str(), O_RDONLY);
+
+  if (fd < 0)
+    throw std::runtime_error("Cannot open the '" + path + "' file.");
+
+  struct stat status;
+
+  if (fstat(fd, &status) != 0) {
+    close(fd);
+    throw std::runtime_error("Cannot access the '" + path + "' file.");
+  }
+
+  length = static_cast<size_t>(status.st_size);
+
+  /* An empty file cannot be mapped, and has no content to map anyway. */
+  if (length > 0) {
+    void* mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (mapping == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("Cannot map the '" + path + "' file.");
+    }
+
+    data = static_cast<const uint8_t*>(mapping);
+  }
+
+  /* The mapping remains valid once the descriptor is closed. */
+  close(fd);
+}
+
+/******************************************************************************/
+
+MappedFile::~MappedFile() {
+  if (data != NULL)
+    munmap(const_cast<uint8_t*>(data), length);
+}
+
+/* ========================================================================== *
+ * MappedScratch                                                              *
+ * ========================================================================== */
+
+MappedScratch::MappedScratch(const std::string& folder, size_t length) :
+data(NULL),
+length(length) {
+  std::string pattern = folder + "/labgen-p-XXXXXX";
+  std::vector<char> path(pattern.begin(), pattern.end());
+  path.push_back('\0');
+
+  int fd = mkstemp(path.data());
+
+  if (fd < 0)
+    throw std::runtime_error("Cannot create a file in the '" + folder + "' folder.");
+
+  unlink(path.data());
+
+  if (ftruncate(fd, static_cast<off_t>(length)) != 0) {
+    close(fd);
+    throw std::runtime_error("Cannot allocate a file in the '" + folder + "' folder.");
+  }
+
+  void* mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (mapping == MAP_FAILED)
+    throw std::runtime_error("Cannot map a file in the '" + folder + "' folder.");
+
+  data = static_cast<uint8_t*>(mapping);
+}
+
+/******************************************************************************/
+
+MappedScratch::~MappedScratch() {
+  munmap(data, length);
+}
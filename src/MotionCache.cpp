@@ -0,0 +1,418 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include <zlib.h>
+
+#include <labgen-p/MotionCache.hpp>
+
+/* ========================================================================== *
+ * Format                                                                     *
+ * ========================================================================== */
+
+static const char CACHE_MAGIC[8] = {'L', 'a', 'B', 'G', 'e', 'n', 'M', '2'};
+
+/* Alignment of the maps in the file, in bytes. */
+static const size_t CACHE_ALIGNMENT = 64;
+
+/******************************************************************************/
+
+template <typename T>
+static T readCacheValue(const uint8_t*& cursor, const uint8_t* end) {
+  if (static_cast<size_t>(end - cursor) < sizeof(T))
+    throw std::runtime_error("The motion cache is truncated!");
+
+  T value;
+  std::memcpy(&value, cursor, sizeof(T));
+  cursor += sizeof(T);
+
+  return value;
+}
+
+/******************************************************************************/
+
+template <typename T>
+static void writeCacheValue(std::ostream& stream, T value) {
+  stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+/******************************************************************************/
+
+/* Size of the values of the maps, which are CV_16UC1 or CV_32SC1 matrices. */
+static size_t getValueSize(int type) {
+  return (type == CV_16UC1) ? sizeof(uint16_t) : sizeof(int32_t);
+}
+
+/******************************************************************************/
+
+/* Size of a header holding a key of the given length, padding included. */
+static size_t getHeaderSize(size_t keyLength) {
+  size_t size =
+    sizeof(CACHE_MAGIC) + sizeof(uint32_t) + keyLength +
+    4 * sizeof(uint32_t) + sizeof(uint64_t);
+
+  return (size + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT;
+}
+
+/******************************************************************************/
+
+/*
+ * Differences between each value of a map and the previous one of its row, or
+ * the first one of the row above for the first column, with the arithmetic of
+ * the unsigned type U, so that they are exactly reversible. Their signs are
+ * interleaved ("zigzag"), so that the small differences have high bytes at 0,
+ * and the bytes of the differences are stored in planes, byte b of every value
+ * being in plane b, giving zlib long runs of similar bytes.
+ */
+template <typename U>
+static void encodeRows(const cv::Mat& map, uint8_t* residuals) {
+  const int BITS = 8 * sizeof(U);
+  size_t plane = static_cast<size_t>(map.rows) * map.cols;
+
+  for (int row = 0; row < map.rows; ++row, residuals += map.cols) {
+    const U* values = map.ptr<U>(row);
+    U previous = (row == 0) ? U() : map.ptr<U>(row - 1)[0];
+
+    for (int col = 0; col < map.cols; ++col) {
+      U difference = static_cast<U>(values[col] - previous);
+      U residual = static_cast<U>(
+        static_cast<U>(difference << 1) ^ static_cast<U>(0 - (difference >> (BITS - 1)))
+      );
+
+      for (size_t b = 0; b < sizeof(U); ++b)
+        residuals[b * plane + col] = static_cast<uint8_t>(residual >> (8 * b));
+
+      previous = values[col];
+    }
+  }
+}
+
+/******************************************************************************/
+
+/* Inverse of encodeRows(). */
+template <typename U>
+static void decodeRows(const uint8_t* residuals, cv::Mat& map) {
+  size_t plane = static_cast<size_t>(map.rows) * map.cols;
+
+  for (int row = 0; row < map.rows; ++row, residuals += map.cols) {
+    U* values = map.ptr<U>(row);
+    U previous = (row == 0) ? U() : map.ptr<U>(row - 1)[0];
+
+    for (int col = 0; col < map.cols; ++col) {
+      U residual = U();
+
+      for (size_t b = 0; b < sizeof(U); ++b)
+        residual |= static_cast<U>(residuals[b * plane + col]) << (8 * b);
+
+      U difference = static_cast<U>((residual >> 1) ^ static_cast<U>(0 - (residual & 1)));
+
+      values[col] = previous = static_cast<U>(previous + difference);
+    }
+  }
+}
+
+/* ========================================================================== *
+ * MotionCache                                                                *
+ * ========================================================================== */
+
+MotionCache::MotionCache(const std::string& path) :
+file(path),
+key(),
+rows(0),
+cols(0),
+type(0),
+frames(0),
+level(0),
+maps(NULL),
+offsets(),
+inflater(),
+residuals(),
+decoded() {
+  const uint8_t* cursor = file.getData();
+  const uint8_t* end = file.getData() + file.getSize();
+
+  if (
+    file.getSize() < sizeof(CACHE_MAGIC) ||
+    std::memcmp(cursor, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0
+  )
+    throw std::runtime_error("'" + path + "' is not a motion cache!");
+
+  cursor += sizeof(CACHE_MAGIC);
+
+  uint32_t keyLength = readCacheValue<uint32_t>(cursor, end);
+
+  if (static_cast<size_t>(end - cursor) < keyLength)
+    throw std::runtime_error("The motion cache is truncated!");
+
+  key.assign(reinterpret_cast<const char*>(cursor), keyLength);
+  cursor += keyLength;
+
+  rows   = readCacheValue<uint32_t>(cursor, end);
+  cols   = readCacheValue<uint32_t>(cursor, end);
+  type   = readCacheValue<uint32_t>(cursor, end);
+  level  = readCacheValue<uint32_t>(cursor, end);
+  frames = readCacheValue<uint64_t>(cursor, end);
+
+  if (type != CV_16UC1 && type != CV_32SC1)
+    throw std::runtime_error("Unsupported type of the motion cache!");
+
+  if (level < 0 || level > 9)
+    throw std::runtime_error("Unsupported compression of the motion cache!");
+
+  size_t header = getHeaderSize(keyLength);
+  size_t mapSize = static_cast<size_t>(rows) * cols * getValueSize(type);
+
+  if (file.getSize() < header)
+    throw std::runtime_error("The motion cache is truncated!");
+
+  maps = file.getData() + header;
+
+  if (level == 0) {
+    if (file.getSize() - header < frames * mapSize)
+      throw std::runtime_error("The motion cache is truncated!");
+
+    return;
+  }
+
+  /* Each compressed map is preceded by its size. */
+  offsets.reserve(frames + 1);
+  cursor = maps;
+
+  for (size_t num = 0; num < frames; ++num) {
+    offsets.push_back(cursor - maps);
+
+    uint64_t size = readCacheValue<uint64_t>(cursor, end);
+
+    if (static_cast<uint64_t>(end - cursor) < size)
+      throw std::runtime_error("The motion cache is truncated!");
+
+    cursor += size;
+  }
+
+  offsets.push_back(cursor - maps);
+
+  inflater.reset(new z_stream());
+
+  if (inflateInit(inflater.get()) != Z_OK) {
+    inflater.reset();
+    throw std::runtime_error("Cannot decompress the motion cache!");
+  }
+
+  residuals.resize(mapSize);
+  decoded.create(rows, cols, type);
+}
+
+/******************************************************************************/
+
+MotionCache::~MotionCache() {
+  if (inflater)
+    inflateEnd(inflater.get());
+}
+
+/******************************************************************************/
+
+cv::Mat MotionCache::getQuantities(size_t num) {
+  if (num >= frames)
+    throw std::out_of_range("The frame is not in the motion cache");
+
+  size_t mapSize = static_cast<size_t>(rows) * cols * getValueSize(type);
+
+  if (level == 0)
+    return cv::Mat(rows, cols, type, const_cast<uint8_t*>(maps + num * mapSize));
+
+  size_t begin = offsets[num] + sizeof(uint64_t);
+
+  inflateReset(inflater.get());
+
+  inflater->next_in = const_cast<Bytef*>(maps + begin);
+  inflater->avail_in = offsets[num + 1] - begin;
+  inflater->next_out = residuals.data();
+  inflater->avail_out = mapSize;
+
+  if (inflate(inflater.get(), Z_FINISH) != Z_STREAM_END || inflater->avail_out != 0)
+    throw std::runtime_error("The motion cache is corrupted!");
+
+  if (type == CV_16UC1)
+    decodeRows<uint16_t>(residuals.data(), decoded);
+  else
+    decodeRows<uint32_t>(residuals.data(), decoded);
+
+  return decoded;
+}
+
+/******************************************************************************/
+
+std::string MotionCache::getPath(const std::string& folder, const std::string& key) {
+  std::stringstream path;
+  path << folder << "/motion_" << std::hex << std::setfill('0') << std::setw(16)
+       << getHash(key) << ".lgm";
+
+  return path.str();
+}
+
+/******************************************************************************/
+
+uint64_t MotionCache::getHash(const std::string& data) {
+  uint64_t hash = 14695981039346656037ULL;
+
+  for (size_t i = 0; i < data.size(); ++i) {
+    hash ^= static_cast<uint8_t>(data[i]);
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+/* ========================================================================== *
+ * MotionCacheWriter                                                          *
+ * ========================================================================== */
+
+MotionCacheWriter::MotionCacheWriter(
+  const std::string& path,
+  const std::string& key,
+  const cv::Size& size,
+  int type,
+  int level
+) :
+path(path),
+temporary(path + ".tmp"),
+stream(),
+rows(size.height),
+cols(size.width),
+type(type),
+frames(0),
+level(level),
+framesOffset(0),
+deflater(),
+residuals(),
+compressed() {
+  if (type != CV_16UC1 && type != CV_32SC1)
+    throw std::logic_error("Only CV_16UC1 and CV_32SC1 maps can be cached");
+
+  if (level < 0 || level > 9)
+    throw std::logic_error("The compression level must be between 0 and 9");
+
+  if (level > 0) {
+    deflater.reset(new z_stream());
+
+    /* Default window and memory of deflateInit(). */
+    if (deflateInit2(deflater.get(), level, Z_DEFLATED, 15, 8, Z_RLE) != Z_OK) {
+      deflater.reset();
+      throw std::runtime_error("Cannot compress the motion cache!");
+    }
+
+    size_t mapSize = static_cast<size_t>(rows) * cols * getValueSize(type);
+
+    residuals.resize(mapSize);
+    compressed.resize(deflateBound(deflater.get(), mapSize));
+  }
+
+  stream.open(temporary.c_str(), std::ios::binary | std::ios::trunc);
+
+  if (!stream)
+    throw std::runtime_error("Cannot create the '" + temporary + "' motion cache.");
+
+  stream.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+
+  writeCacheValue<uint32_t>(stream, key.size());
+  stream.write(key.data(), key.size());
+
+  writeCacheValue<uint32_t>(stream, rows);
+  writeCacheValue<uint32_t>(stream, cols);
+  writeCacheValue<uint32_t>(stream, type);
+  writeCacheValue<uint32_t>(stream, level);
+
+  /* The number of frames is known once the cache is closed. */
+  framesOffset = stream.tellp();
+  writeCacheValue<uint64_t>(stream, 0);
+
+  size_t padding = getHeaderSize(key.size()) - static_cast<size_t>(stream.tellp());
+  const char zeros[CACHE_ALIGNMENT] = { 0 };
+
+  stream.write(zeros, padding);
+}
+
+/******************************************************************************/
+
+MotionCacheWriter::~MotionCacheWriter() {
+  if (deflater)
+    deflateEnd(deflater.get());
+
+  if (stream.is_open()) {
+    stream.close();
+    std::remove(temporary.c_str());
+  }
+}
+
+/******************************************************************************/
+
+void MotionCacheWriter::write(const cv::Mat& quantities) {
+  if (quantities.rows != rows || quantities.cols != cols || quantities.type() != type)
+    throw std::logic_error("The map does not match the motion cache");
+
+  if (level == 0) {
+    size_t rowSize = static_cast<size_t>(cols) * getValueSize(type);
+
+    for (int row = 0; row < rows; ++row)
+      stream.write(reinterpret_cast<const char*>(quantities.ptr(row)), rowSize);
+
+    ++frames;
+    return;
+  }
+
+  if (type == CV_16UC1)
+    encodeRows<uint16_t>(quantities, residuals.data());
+  else
+    encodeRows<uint32_t>(quantities, residuals.data());
+
+  deflateReset(deflater.get());
+
+  deflater->next_in = residuals.data();
+  deflater->avail_in = residuals.size();
+  deflater->next_out = compressed.data();
+  deflater->avail_out = compressed.size();
+
+  if (deflate(deflater.get(), Z_FINISH) != Z_STREAM_END)
+    throw std::runtime_error("Cannot compress the map of the motion cache!");
+
+  uint64_t size = compressed.size() - deflater->avail_out;
+
+  writeCacheValue<uint64_t>(stream, size);
+  stream.write(reinterpret_cast<const char*>(compressed.data()), size);
+
+  ++frames;
+}
+
+/******************************************************************************/
+
+void MotionCacheWriter::close() {
+  stream.seekp(framesOffset);
+  writeCacheValue<uint64_t>(stream, frames);
+  stream.close();
+
+  if (!stream)
+    throw std::runtime_error("Cannot write the '" + temporary + "' motion cache.");
+
+  if (std::rename(temporary.c_str(), path.c_str()) != 0)
+    throw std::runtime_error("Cannot rename the motion cache to '" + path + "'.");
+}
@@ -0,0 +1,195 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+
+#include <labgen-p/ThreadPool.hpp>
+
+/* ========================================================================== *
+ * ThreadPool                                                                 *
+ * ========================================================================== */
+
+/* Pool whose chunks the thread is processing, if any. */
+static thread_local const ThreadPool* processing = NULL;
+
+/******************************************************************************/
+
+ThreadPool::ThreadPool(size_t threads) :
+workers(),
+body(NULL),
+end(0),
+chunk(0),
+next(0),
+generation(0),
+active(0),
+stopped(false) {
+  if (threads == 0)
+    threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+  workers.reserve(threads - 1);
+
+  for (size_t i = 1; i < threads; ++i)
+    workers.push_back(std::thread(&ThreadPool::work, this));
+}
+
+/******************************************************************************/
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopped = true;
+  }
+
+  wakeUp.notify_all();
+
+  for (size_t i = 0; i < workers.size(); ++i)
+    workers[i].join();
+}
+
+/******************************************************************************/
+
+/*
+ * A few chunks per thread balance the load when some chunks are longer to
+ * process than others.
+ */
+void ThreadPool::parallelFor(
+  size_t begin,
+  size_t end,
+  const Body& body,
+  size_t grain
+) {
+  if (begin >= end)
+    return;
+
+  grain = std::max(grain, static_cast<size_t>(1));
+
+  size_t chunks = 4 * size();
+  size_t chunk = (end - begin + chunks - 1) / chunks;
+  chunk = std::max((chunk + grain - 1) / grain * grain, grain);
+
+  /*
+   * A loop started by a body of this pool is processed serially, since its
+   * calling thread may already own the callers mutex.
+   */
+  std::unique_lock<std::mutex> caller(callers, std::defer_lock);
+
+  if (processing != this)
+    caller.try_lock();
+
+  if (workers.empty() || chunk >= end - begin || !caller.owns_lock()) {
+    body(begin, end);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    this->body = &body;
+    this->end = end;
+    this->chunk = chunk;
+    next = begin;
+
+    ++generation;
+    active = workers.size();
+  }
+
+  wakeUp.notify_all();
+  process();
+
+  std::exception_ptr failure;
+
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return active == 0; });
+
+    this->body = NULL;
+    std::swap(failure, error);
+  }
+
+  if (failure)
+    std::rethrow_exception(failure);
+}
+
+/******************************************************************************/
+
+void ThreadPool::run(
+  ThreadPool* pool,
+  size_t begin,
+  size_t end,
+  const Body& body,
+  size_t grain
+) {
+  if (pool != NULL)
+    pool->parallelFor(begin, end, body, grain);
+  else if (begin < end)
+    body(begin, end);
+}
+
+/******************************************************************************/
+
+void ThreadPool::work() {
+  size_t seen = 0;
+
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wakeUp.wait(lock, [this, seen] { return stopped || generation != seen; });
+
+      if (stopped)
+        return;
+
+      seen = generation;
+    }
+
+    process();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      if (--active == 0)
+        done.notify_one();
+    }
+  }
+}
+
+/******************************************************************************/
+
+void ThreadPool::process() {
+  /* A body may process the loop of another pool. */
+  const ThreadPool* outer = processing;
+  processing = this;
+
+  for (;;) {
+    size_t chunkBegin = next.fetch_add(chunk);
+
+    if (chunkBegin >= end)
+      break;
+
+    try {
+      (*body)(chunkBegin, std::min(chunkBegin + chunk, end));
+    }
+    catch (...) {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      if (!error)
+        error = std::current_exception();
+    }
+  }
+
+  processing = outer;
+}
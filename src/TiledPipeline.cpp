@@ -0,0 +1,237 @@
+/**
+ * Copyright - Benjamin Laugraud <blaugraud@ulg.ac.be> - 2016
+ * http://www.montefiore.ulg.ac.be/~blaugraud
+ * http://www.telecom.ulg.ac.be/labgen
+ *
+ * LaBGen-P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LaBGen-P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LaBGen-P.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <stdexcept>
+
+#include <labgen-p/TiledPipeline.hpp>
+
+/* ========================================================================== *
+ * Rows                                                                       *
+ * ========================================================================== */
+
+/* Motion scores of a row, the absolute differences of the lumas. */
+static void computeScores(
+  const uint8_t* luma,
+  const uint8_t* previous,
+  uint8_t* scores,
+  int width
+) {
+  for (int col = 0; col < width; ++col)
+    scores[col] = static_cast<uint8_t>(std::abs(static_cast<int32_t>(luma[col]) - previous[col]));
+}
+
+/******************************************************************************/
+
+/* Adds the motion scores of a row to the sums of the columns, or subtracts them. */
+template <bool Add>
+static void accumulateRow(const uint8_t* scores, int32_t* columns, int width) {
+  for (int col = 0; col < width; ++col)
+    columns[col] += Add ? scores[col] : -static_cast<int32_t>(scores[col]);
+}
+
+/******************************************************************************/
+
+/*
+ * Quantities of motion of a row: the sums of the columns over the kernel
+ * centered on each pixel, cropped to the row.
+ */
+template <typename Key>
+static void sumColumns(const int32_t* columns, int width, int half, Key* quantities) {
+  int32_t sum = 0;
+
+  for (int col = 0; col <= std::min(half, width - 1); ++col)
+    sum += columns[col];
+
+  for (int col = 0; col < width; ++col) {
+    quantities[col] = static_cast<Key>(sum);
+
+    if (col + half + 1 < width)
+      sum += columns[col + half + 1];
+
+    if (col - half >= 0)
+      sum -= columns[col - half];
+  }
+}
+
+/* ========================================================================== *
+ * TiledPipeline                                                              *
+ * ========================================================================== */
+
+TiledPipeline::TiledPipeline(
+  const std::vector<int32_t>& kernelSizes,
+  size_t tiles,
+  ThreadPool* pool
+) :
+kernelSizes(kernelSizes),
+tiles(tiles),
+pool(pool),
+columns(),
+scores() {
+  if (tiles == 0)
+    throw std::logic_error("The number of tiles must be positive");
+}
+
+/******************************************************************************/
+
+size_t TiledPipeline::getTiles(int height) const {
+  size_t rows = std::max(height, 1);
+  size_t halo = std::max(getHalo(), 1);
+
+  return std::max<size_t>(std::min(tiles, rows / halo), 1);
+}
+
+/******************************************************************************/
+
+int TiledPipeline::getHalo() const {
+  int halo = 0;
+
+  for (size_t n = 0; n < kernelSizes.size(); ++n)
+    halo = std::max(halo, kernelSizes[n] / 2);
+
+  return halo;
+}
+
+/******************************************************************************/
+
+size_t TiledPipeline::process(
+  const cv::Mat& luma,
+  const cv::Mat& previous,
+  const cv::Mat& colors,
+  std::vector<cv::Mat>& quantities,
+  std::vector<std::shared_ptr<BasePatchesHistory> >& histories
+) {
+  if (luma.type() != CV_8UC1 || previous.type() != CV_8UC1 || previous.size() != luma.size())
+    throw std::runtime_error("The lumas must be CV_8UC1 matrices of the same size!");
+
+  if (colors.type() != CV_8UC3 || colors.size() != luma.size())
+    throw std::runtime_error("The colors must be a CV_8UC3 matrix of the size of the lumas!");
+
+  if (quantities.size() != kernelSizes.size() || histories.size() != kernelSizes.size())
+    throw std::logic_error("There must be one map and one history per kernel size");
+
+  for (size_t n = 0; n < kernelSizes.size(); ++n) {
+    if (kernelSizes[n] / 2 == 0)
+      throw std::runtime_error("Size divided by 2 is zero!");
+
+    if (quantities[n].size() != luma.size())
+      throw std::runtime_error("The quantities of motion must have the size of the lumas!");
+  }
+
+  size_t rows = luma.rows;
+  size_t count = getTiles(luma.rows);
+  size_t tileColumns = kernelSizes.size() * luma.cols;
+  size_t tileScores = ((rows + count - 1) / count + 2 * getHalo()) * luma.cols;
+
+  columns.resize(count * tileColumns);
+  scores.resize(count * tileScores);
+
+  std::atomic<size_t> modified(0);
+
+  ThreadPool::run(pool, 0, count, [&](size_t first, size_t last) {
+    size_t tileModified = 0;
+
+    for (size_t tile = first; tile < last; ++tile) {
+      tileModified += processTile(
+        luma,
+        previous,
+        colors,
+        quantities,
+        histories,
+        rows * tile / count,
+        rows * (tile + 1) / count,
+        columns.data() + tile * tileColumns,
+        scores.data() + tile * tileScores
+      );
+    }
+
+    modified += tileModified;
+  });
+
+  return modified;
+}
+
+/******************************************************************************/
+
+/*
+ * The sums of the columns of each kernel size cover the rows
+ * [row - half, row + half] of the image when the quantities of motion of the
+ * row are computed. The scores hold the rows [first, last) of the image.
+ */
+size_t TiledPipeline::processTile(
+  const cv::Mat& luma,
+  const cv::Mat& previous,
+  const cv::Mat& colors,
+  std::vector<cv::Mat>& quantities,
+  std::vector<std::shared_ptr<BasePatchesHistory> >& histories,
+  int begin,
+  int end,
+  int32_t* columns,
+  uint8_t* scores
+) const {
+  int height = luma.rows;
+  int width = luma.cols;
+  int first = std::max(begin - getHalo(), 0);
+  int last = std::min(end + getHalo(), height);
+
+  for (int row = first; row < last; ++row)
+    computeScores(luma.ptr(row), previous.ptr(row), scores + (row - first) * width, width);
+
+  std::fill(columns, columns + kernelSizes.size() * width, 0);
+
+  /* Halo above and below the first row. */
+  for (size_t n = 0; n < kernelSizes.size(); ++n) {
+    int half = kernelSizes[n] / 2;
+
+    for (int row = std::max(begin - half, 0); row <= std::min(begin + half, height - 1); ++row)
+      accumulateRow<true>(scores + (row - first) * width, columns + n * width, width);
+  }
+
+  size_t modified = 0;
+
+  for (int row = begin; row < end; ++row) {
+    for (size_t n = 0; n < kernelSizes.size(); ++n) {
+      int half = kernelSizes[n] / 2;
+      int32_t* sums = columns + n * width;
+
+      if (row > begin && row + half < height)
+        accumulateRow<true>(scores + (row + half - first) * width, sums, width);
+
+      if (row > begin && row - half - 1 >= 0)
+        accumulateRow<false>(scores + (row - half - 1 - first) * width, sums, width);
+
+      if (quantities[n].depth() == CV_16U)
+        sumColumns(sums, width, half, quantities[n].ptr<uint16_t>(row));
+      else
+        sumColumns(sums, width, half, quantities[n].ptr<int32_t>(row));
+
+      size_t pixel = static_cast<size_t>(row) * width;
+
+      modified += histories[n]->insertPixels(
+        quantities[n].ptr(row),
+        colors.ptr(row),
+        pixel,
+        pixel + width
+      );
+    }
+  }
+
+  return modified;
+}